@@ -19,6 +19,14 @@ struct MongoConfig {
   std::string dbName;
 };
 
+struct ProcessorQueueConfig {
+  std::string processor;
+  // Upper bound of the queue prefetch, zero means AmqpConfig::prefetchCount
+  uint16_t prefetchCount{};
+  // Deliveries of the queue processed at once, zero means no limit but the pool
+  uint16_t concurrency{};
+};
+
 struct AmqpConfig {
   std::string user;
   std::string passwd;
@@ -27,12 +35,29 @@ struct AmqpConfig {
   uint16_t port{};
   uint16_t heartbeat{};
 
+  // Upper bound of ProcessImage prefetch, below it prefetch follows free capacity of the worker pool
   uint16_t prefetchCount{};
+
+  // Seconds running tasks may take to finish on shutdown
+  uint16_t drainTimeout{};
+
+  // Consume the ProcessImage queue shared by all processors besides the ProcessImage.<processor> ones
+  bool sharedProcessImageQueue{true};
+  // Limits of ProcessImage.<processor> queues, a processor without an entry has the defaults
+  std::vector<ProcessorQueueConfig> processorQueues;
+};
+
+struct WorkerPoolConfig {
+  // "none", "compact" or "spread" across NUMA nodes
+  std::string placement{"none"};
+  // CPUs workers may run on, empty means all of them
+  std::vector<uint32_t> cpus;
 };
 
 struct AppConfig {
   MongoConfig dbConfig;
   AmqpConfig transportConfig;
+  WorkerPoolConfig workerConfig;
   ProcessorModules modules;
 };
 
@@ -12,6 +12,7 @@ namespace limb {
 class JsonTaskParser : public TaskParser {
 public:
   liret parse(const uint8_t *data, size_t size, ImageTask &task) override;
+  liret parsePadded(const uint8_t *data, size_t size, ImageTask &task) override;
   liret serialize(std::vector<uint8_t> &data, const ImageTaskResult &task) override;
 
   liret parse(const uint8_t *data, size_t size, PingTask &task) override;
@@ -20,6 +21,8 @@ public:
   liret serialize(std::vector<uint8_t> &data, const AppInfoTask &task) override;
 
 private:
+  liret fromDocument(const simdjson::dom::element &doc, ImageTask &task);
+
   simdjson::dom::parser m_parser;
   simdjson::builder::string_builder m_builder;
 
@@ -7,6 +7,9 @@
 
 namespace limb {
 
+// Readable bytes parsePadded expects after the data
+constexpr size_t PARSE_PADDING = 64;
+
 enum class TaskParserType {
   kJson = 0,
   kProtobuf = 1,
@@ -19,6 +22,8 @@ public:
   virtual ~TaskParser() = default;
 
   virtual liret parse(const uint8_t *data, size_t size, ImageTask &task) = 0;
+  // Same as parse, but data is followed by PARSE_PADDING readable bytes, so it is parsed in place without a copy.
+  virtual liret parsePadded(const uint8_t *data, size_t size, ImageTask &task) = 0;
   virtual liret serialize(std::vector<uint8_t> &data, const ImageTaskResult &task) = 0;
 
   virtual liret parse(const uint8_t *data, size_t size, PingTask &task) = 0;
@@ -10,6 +10,9 @@
 namespace limb {
 
 struct ImageTask {
+  // Set when the request doesn't name the model, the queue it came from does
+  static constexpr uint32_t NO_MODEL = UINT32_MAX;
+
   uint32_t modelId;
   std::string imageId;
 };
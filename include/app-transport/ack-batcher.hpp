@@ -0,0 +1,96 @@
+#ifndef _ACK_BATCHER_HPP_
+#define _ACK_BATCHER_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <set>
+
+namespace limb {
+
+// Collects acknowledgements of deliveries of a single channel, so they are sent as one 'basic.ack' with the
+// multiple flag instead of a frame per delivery.
+// Multiple ack of tag N settles every outstanding delivery up to N, so it is only sent for the prefix of tags which
+// are all settled already. Deliveries completed out of order past a delivery still running are acknowledged one by
+// one on flush, so a long task does not hold the prefetch window. While it runs, the batching falls back to those
+// single acks. Tracking the prefix per consumer would not help, the multiple flag covers every delivery of the channel
+// whichever consumer it went to; only a channel per consumer would keep the queues from holding back each other.
+// Delivery tags of a channel start at 1 and grow by one. Class is not thread safe, the loop thread owns it.
+class AckBatcher {
+public:
+  // maxPending Number of acks which makes the batch full.
+  explicit AckBatcher(size_t maxPending) : m_maxPending(maxPending) {}
+
+  // Records completed delivery. Returns false if the delivery is settled already, the ack must not be sent then.
+  bool ack(uint64_t deliveryTag) {
+    if (!insert(m_ready, deliveryTag)) {
+      return false;
+    }
+    advance();
+    return true;
+  }
+
+  // Records delivery rejected or requeued by the caller. Returns false if it is settled already.
+  bool settle(uint64_t deliveryTag) {
+    if (!insert(m_settled, deliveryTag)) {
+      return false;
+    }
+    advance();
+    return true;
+  }
+
+  // Number of acks not sent yet.
+  size_t pending() const { return m_prefixCount + m_ready.size(); }
+
+  bool full() const { return pending() >= m_maxPending; }
+
+  // Passes acks to be sent to send(deliveryTag, multiple): one multiple ack for the settled prefix and single acks
+  // for the deliveries completed out of order.
+  template <typename Send> void flush(Send &&send) {
+    if (m_prefixCount != 0) {
+      send(m_prefixAck, true);
+      m_prefixCount = 0;
+    }
+    for (uint64_t deliveryTag : m_ready) {
+      send(deliveryTag, false);
+      m_settled.insert(deliveryTag);
+    }
+    m_ready.clear();
+  }
+
+private:
+  bool insert(std::set<uint64_t> &to, uint64_t deliveryTag) {
+    if (deliveryTag <= m_base || m_ready.count(deliveryTag) != 0 || m_settled.count(deliveryTag) != 0) {
+      return false;
+    }
+    to.insert(deliveryTag);
+    return true;
+  }
+
+  // Moves the prefix over tags which follow it
+  void advance() {
+    for (;;) {
+      if (!m_ready.empty() && *m_ready.begin() == m_base + 1) {
+        m_ready.erase(m_ready.begin());
+        m_prefixAck = ++m_base;
+        m_prefixCount++;
+      } else if (!m_settled.empty() && *m_settled.begin() == m_base + 1) {
+        m_settled.erase(m_settled.begin());
+        ++m_base;
+      } else {
+        return;
+      }
+    }
+  }
+
+  const size_t m_maxPending;
+  // Every delivery up to base is settled or waits for the multiple ack
+  uint64_t m_base = 0;
+  // Tag the multiple ack is sent for and number of deliveries it acknowledges
+  uint64_t m_prefixAck = 0;
+  size_t m_prefixCount = 0;
+  // Past the base: completed deliveries waiting for ack, and deliveries settled otherwise or acked singly
+  std::set<uint64_t> m_ready;
+  std::set<uint64_t> m_settled;
+};
+
+} // namespace limb
+#endif // _ACK_BATCHER_HPP_
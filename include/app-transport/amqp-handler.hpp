@@ -2,6 +2,8 @@
 #define _AMQP_HANDLER_HPP_
 #include <amqpcpp.h>
 
+#include <functional>
+
 #include "app-config.h"
 
 struct AmqpHandlerImpl;
@@ -16,6 +18,12 @@ public:
   void loop();
   void quit();
 
+  // Called on the loop thread on every iteration before output is flushed, and once more when the loop quits.
+  // Must be set before the loop starts.
+  void setLoopHandler(std::function<void()> handler);
+  // Wakes the loop so it calls the loop handler soon, callable from any thread.
+  void wake();
+
   bool connected() const;
 
 private:
@@ -24,7 +32,6 @@ private:
 
   void close_handler();
   void sendDataFromBuffer();
-  void heartbeater(AMQP::Connection *connection, uint16_t interv);
   /**
    *  Method that is called when the server tries to negotiate a heartbeat
    *  interval, and that is overridden to get rid of the default implementation
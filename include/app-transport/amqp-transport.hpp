@@ -2,28 +2,58 @@
 #define _AMQP_ROUTER_HPP_
 #include <amqpcpp.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "ack-batcher.hpp"
 #include "amqp-handler.hpp"
+#include "message-body.hpp"
+#include "prefetch.hpp"
 
 #include "app-config.h"
 #include "limb-app.h"
 
+#include "thread-pool/limb-queue.hpp"
+#include "thread-pool/resource-scheduler.hpp"
 #include "thread-pool/thread-pool.hpp"
+#include "thread-pool/unbounded-queue.hpp"
 #include "utils/status.h"
 
 namespace limb {
 
 struct AmqpTask {
-  const std::string correlationID;
-  const std::string replyTo;
+  // Point into body
+  std::string_view correlationID;
+  std::string_view replyTo;
 
   uint64_t deliveryTag;
+  // Model of the ProcessImage.<processor> queue the delivery came from, ImageTask::NO_MODEL for the shared queue
+  uint32_t modelId = ImageTask::NO_MODEL;
 
-  std::vector<uint8_t> body;
+  // Padded for parsing in place, returned to the transport's pool with the task
+  MessageBody body;
+
+  // Tripped by a CancelProcessImage message with the same correlation id or when the message expires
+  tp::CancellationToken token;
+};
+
+struct DrainStats {
+  // Running deliveries which completed before the deadline
+  size_t finished = 0;
+  // Deliveries which had not started, returned to the broker
+  size_t requeued = 0;
+  // Running deliveries cancelled at the deadline and returned to the broker
+  size_t cancelled = 0;
+  // Deliveries still running after the cancellation grace, the broker redelivers them on disconnect
+  size_t abandoned = 0;
 };
 
 class AmqpTransport {
@@ -34,12 +64,24 @@ public:
   liret loop();
   void quit();
 
+  // Snapshot of worker pool counters, safe to call from any thread.
+  tp::ThreadPoolStats poolStats() const;
+
+  // Stops consuming ProcessImage, requeues deliveries which have not started and lets the running ones finish
+  // until the timeout, then cancels them. Called from any thread but the loop one, which has to keep running.
+  DrainStats drain(std::chrono::milliseconds timeout);
+
   virtual void handlePing(const AMQP::Message &message, uint64_t deliveryTag) = 0;
   virtual void handleGetAppInfo(const AMQP::Message &message, uint64_t deliveryTag) = 0;
-  virtual void handleProcessImage(AmqpTask &message) = 0;
+  // Runs as a coroutine started on a pool worker, it owns the task.
+  // A cancelled task is expected to be rejected without a response.
+  virtual tp::CoTask<void> handleProcessImage(AmqpTask message) = 0;
 
 protected:
-  liret init();
+  // Consumes ProcessImage.<name> queue for every processor besides the shared ProcessImage one.
+  liret init(const std::vector<AppInfoTask::AvailableProcessor> &processors);
+
+  tp::ThreadPool &pool();
 
   // Sends a response using a task state object.
   // This version is intended for scenarios where multiple messages may be sent using the same task.
@@ -52,15 +94,112 @@ protected:
 
   void sendReject(uint64_t deliveryTag);
   void sendAck(uint64_t deliveryTag);
+  // Returns the delivery to the broker, so another instance processes it.
+  void sendRequeue(uint64_t deliveryTag);
+  // Rejects cancelled delivery, the ones cancelled by drain are requeued.
+  void sendCancelled(uint64_t deliveryTag);
 
 private:
+  // ProcessImage queue, the shared one or the one of a processor
+  struct ProcessImageQueue {
+    // Queue name and consumer tag
+    std::string name;
+    uint32_t modelId;
+    uint16_t maxPrefetch;
+    uint16_t prefetch = 0;
+    // Caps deliveries of the queue processed at once, its CPU slots are the cap. Null if there is no cap.
+    std::unique_ptr<tp::ResourceScheduler> limit;
+  };
+
+  // Starts (or restarts) consumption of the queue with given prefetch, the current target by default.
+  void consumeProcessImage(ProcessImageQueue &queue, uint16_t prefetch = 0);
+
+  // Prefetch matching the queue's share of free pool capacity: deliveries the workers take minus the ones in
+  // flight, at most the queue's maximum.
+  uint16_t prefetchTarget(const ProcessImageQueue &queue);
+  // Restarts ProcessImage consumers whose target has moved away from their prefetch.
+  void adjustPrefetch();
+  void scheduleAdjustPrefetch();
+
+  // Pauses ProcessImage consumption while the pool is saturated, so the broker keeps the backlog.
+  void onPoolSaturation(bool saturated);
+
+  // Registers the delivery as in flight, its token trips on cancel request or expiration.
+  tp::CancellationToken trackTask(const AMQP::Message &message, uint64_t deliveryTag);
+  void untrackTask(uint64_t deliveryTag);
+  // Marks the delivery as started, false if drain has already requeued it.
+  bool startTask(uint64_t deliveryTag);
+  // Cancels every in flight delivery with the correlation id.
+  void cancelTask(const std::string &correlationID);
+  // Settles the delivery whose processing has thrown: rejects it, or requeues it while draining.
+  void settleFailed(uint64_t deliveryTag);
+
+  // Waits for the queue's concurrency cap, runs handleProcessImage and drops the delivery from the in flight ones
+  // when it is done, however it ends. A delivery whose processing throws is settled by settleFailed.
+  tp::CoTask<void> runProcessImage(AmqpTask task, ProcessImageQueue &queue, size_t lane);
+
+  // Channel operation requested by any thread and performed by the loop thread, AMQP-CPP is not thread safe.
+  struct ChannelCommand {
+    enum class Kind { kPublish, kAck, kReject, kRequeue, kFlushAcks, kPauseConsumer, kResumeConsumer, kAdjustPrefetch };
+
+    Kind kind = Kind::kAck;
+    uint64_t deliveryTag = 0;
+    // Publish only, acknowledges deliveryTag after the response is published
+    bool ack = false;
+    std::string replyTo;
+    std::string correlationID;
+    std::vector<uint8_t> body;
+  };
+
+  // Queues the command and wakes the loop, never blocks on the channel.
+  void enqueue(ChannelCommand command);
+  // Builds a publish command in a spare one, so its strings and body don't allocate once they have grown.
+  ChannelCommand publishCommand(uint64_t deliveryTag, bool ack, std::string_view replyTo,
+                                std::string_view correlationID, const void *body, size_t size);
+  // Performs queued commands, called by the loop thread.
+  void runCommands();
+  void runCommand(ChannelCommand &command);
+  // Batches ack of the delivery, sent when the batch is full or by the flush timer.
+  void batchAck(uint64_t deliveryTag);
+  void flushAcks();
+
+  struct InflightTask {
+    std::string correlationID;
+    tp::CancellationSource source;
+    bool started = false;
+    // Cancelled by drain, so it is requeued instead of rejected
+    bool requeue = false;
+  };
+
   AmqpHandler m_handler;
   AMQP::Connection m_connection;
   AMQP::Channel m_ch;
 
-  std::mutex m_chMutex;
+  // Outlive the pool, whose tasks own the bodies and wait for the queue limits
+  MessageBodyPool m_bodies;
+  // Filled by init
+  std::vector<ProcessImageQueue> m_processQueues;
+
+  tp::MPMCUnboundedQueue<ChannelCommand> m_commands;
+  // Commands popped by one batch, used by runCommands only
+  std::vector<ChannelCommand> m_commandBatch;
+  // Publish commands given back by runCommands after publishing
+  tp::MPMCBoundedQueue<ChannelCommand> m_spareCommands;
+  // Used by runCommands only
+  AckBatcher m_acks;
+  tp::TimerHandle m_ackTimer;
+  // ProcessImage consumers state, used by init and then by runCommands only
+  bool m_consuming = false;
+  tp::TimerHandle m_prefetchTimer;
   const AmqpConfig &m_conf;
 
+  // Keyed by delivery tag, correlation ids are not guaranteed to be unique
+  std::unordered_map<uint64_t, InflightTask> m_inflight;
+  std::mutex m_inflightMutex;
+  // Notified when a delivery stops being in flight
+  std::condition_variable m_inflightCv;
+  std::atomic<bool> m_draining;
+
   tp::ThreadPool m_pool;
 };
 
@@ -73,7 +212,7 @@ public:
 
   void handlePing(const AMQP::Message &message, uint64_t deliveryTag) override;
   void handleGetAppInfo(const AMQP::Message &message, uint64_t deliveryTag) override;
-  void handleProcessImage(AmqpTask &message) override;
+  tp::CoTask<void> handleProcessImage(AmqpTask message) override;
 
 private:
   AppBase *m_app;
@@ -0,0 +1,118 @@
+#ifndef _MESSAGE_BODY_HPP_
+#define _MESSAGE_BODY_HPP_
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "thread-pool/limb-queue.hpp"
+
+namespace limb {
+
+class MessageBodyPool;
+
+// Delivery copied once from the frame into a pooled block: body, then PADDING zero bytes, so the parser reads it in
+// place, then the correlation id and reply queue, so they need no strings of their own. Views stay valid when the
+// body is moved, the block returns to the pool on destruction.
+class MessageBody {
+public:
+  // Readable bytes after the body, enough for SIMD JSON parsing
+  static constexpr size_t PADDING = 64;
+
+  MessageBody() = default;
+  MessageBody(MessageBody &&rhs) noexcept { swap(rhs); }
+  MessageBody &operator=(MessageBody &&rhs) noexcept {
+    MessageBody(std::move(rhs)).swap(*this);
+    return *this;
+  }
+  ~MessageBody() { release(); }
+
+  const uint8_t *data() const { return m_block; }
+  size_t size() const { return m_size; }
+  // False for heap blocks, taken by deliveries too large for any size or past the budget of theirs
+  bool pooled() const;
+
+  std::string_view correlationID() const {
+    return {reinterpret_cast<const char *>(m_block) + m_size + PADDING, m_idSize};
+  }
+  std::string_view replyTo() const {
+    return {reinterpret_cast<const char *>(m_block) + m_size + PADDING + m_idSize, m_replySize};
+  }
+
+private:
+  friend class MessageBodyPool;
+
+  MessageBody(const MessageBody &) = delete;
+  MessageBody &operator=(const MessageBody &) = delete;
+
+  void swap(MessageBody &rhs) noexcept {
+    std::swap(m_pool, rhs.m_pool);
+    std::swap(m_block, rhs.m_block);
+    std::swap(m_size, rhs.m_size);
+    std::swap(m_idSize, rhs.m_idSize);
+    std::swap(m_replySize, rhs.m_replySize);
+    std::swap(m_sizeClass, rhs.m_sizeClass);
+  }
+
+  void release() noexcept;
+
+  MessageBodyPool *m_pool = nullptr;
+  uint8_t *m_block = nullptr;
+  size_t m_size = 0;
+  uint16_t m_idSize = 0;
+  uint16_t m_replySize = 0;
+  uint16_t m_sizeClass = 0;
+};
+
+// Blocks of power of two sizes carved from 64 KiB slabs. Free blocks of every size are kept in a lock-free queue, so
+// the loop thread acquires and the workers release them without locking. A size takes new slabs until it holds
+// CLASS_BUDGET bytes, larger deliveries and those past the budget get heap blocks.
+// The pool must outlive its bodies.
+class MessageBodyPool {
+public:
+  static constexpr size_t MIN_BLOCK = 256;
+  static constexpr size_t CLASS_COUNT = 9;
+  static constexpr size_t SLAB_SIZE = 64 * 1024;
+  static constexpr size_t CLASS_BUDGET = 1024 * 1024;
+
+  MessageBodyPool();
+
+  MessageBody acquire(const void *body, size_t size, std::string_view correlationID, std::string_view replyTo);
+
+private:
+  friend class MessageBody;
+
+  MessageBodyPool(const MessageBodyPool &) = delete;
+  MessageBodyPool &operator=(const MessageBodyPool &) = delete;
+
+  static constexpr uint16_t HEAP_CLASS = CLASS_COUNT;
+
+  struct SizeClass {
+    explicit SizeClass(size_t blockCount) : free(blockCount) {}
+
+    tp::MPMCBoundedQueue<uint8_t *> free;
+    // Guards growth only
+    std::mutex mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> slabs;
+  };
+
+  uint8_t *allocate(uint16_t sizeClass);
+  void release(uint8_t *block, uint16_t sizeClass) noexcept;
+
+  std::array<std::unique_ptr<SizeClass>, CLASS_COUNT> m_classes;
+};
+
+inline bool MessageBody::pooled() const { return m_block != nullptr && m_sizeClass != MessageBodyPool::HEAP_CLASS; }
+
+inline void MessageBody::release() noexcept {
+  if (m_block) {
+    m_pool->release(std::exchange(m_block, nullptr), m_sizeClass);
+  }
+}
+
+} // namespace limb
+#endif // _MESSAGE_BODY_HPP_
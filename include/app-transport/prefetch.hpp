@@ -0,0 +1,22 @@
+#ifndef _PREFETCH_HPP_
+#define _PREFETCH_HPP_
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace limb {
+
+// Prefetch of every ProcessImage queue: capacity of the worker pool not taken by deliveries in flight, split evenly
+// between the queues. At least one, so a busy pool still takes work once it frees up, and at most maxPrefetch.
+inline uint16_t prefetchForCapacity(size_t capacity, size_t inflight, size_t queueCount, uint16_t maxPrefetch) {
+  const size_t free = capacity > inflight ? capacity - inflight : 0;
+  return uint16_t(std::clamp<size_t>(free / std::max<size_t>(queueCount, 1), 1, std::max<uint16_t>(maxPrefetch, 1)));
+}
+
+// Restarting the consumer costs a round trip, so the prefetch is changed only when the target is 1.5 times away.
+inline bool prefetchWorthChanging(uint16_t current, uint16_t target) {
+  return size_t(target) * 2 >= size_t(current) * 3 || size_t(target) * 3 <= size_t(current) * 2;
+}
+
+} // namespace limb
+#endif // _PREFETCH_HPP_
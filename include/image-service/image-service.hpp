@@ -3,6 +3,8 @@
 
 #include "processor-module.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -20,10 +22,21 @@
 #include "processor-initializer.hpp"
 #include "processor-storage.hpp"
 
+#include "thread-pool/coroutine.hpp"
+#include "thread-pool/resource-scheduler.hpp"
+
 #include "utils/status.h"
 
 namespace limb {
 
+// How long processImageAsync waits for a free processor
+inline constexpr auto g_processorWaitTimeout = std::chrono::seconds(30);
+// Longest pause between attempts to take a processor, pauses start at 1 ms and double
+inline constexpr auto g_processorRetryMaxDelay = std::chrono::milliseconds(50);
+
+// Device memory an inference is assumed to take per byte of decoded input: the input plus 4x upscaled output
+inline constexpr size_t g_inferenceMemoryFactor = 17;
+
 template <class Repo>
   requires std::derived_from<std::remove_cvref_t<Repo>, MediaRepository>
 class ImageService {
@@ -38,7 +51,8 @@ public:
 
   virtual ~ImageService() = default;
 
-  virtual liret processImage(const ImageTask &input, const ProgressCallback &&procb = [](float val) {}) {
+  virtual liret processImage(const ImageTask &input, const ProgressCallback &&procb = [](float val) {},
+                             const CancellationToken &token = defaultCancellationToken) {
     uint8_t *inImage;
     size_t size;
 
@@ -47,6 +61,9 @@ public:
       return ret;
     }
     std::unique_ptr<uint8_t[]> inImageData(inImage);
+    if (token.isCancelled()) {
+      return liret::kCancelled;
+    }
 
     image::Container inPixel;
     auto codecFactory = image::CodecFactory::getInstance();
@@ -71,7 +88,7 @@ public:
 
     ImageInfo inImageInfo{.data = inPixel.data.get(), .w = inPixel.w, .h = inPixel.h, .c = inPixel.c};
     ImageInfo outImageInfo;
-    ret = processor->process_image(inImageInfo, outImageInfo, ProgressCallback(procb));
+    ret = processor->process_image(inImageInfo, outImageInfo, ProgressCallback(procb), token);
     if (ret != liret::kOk) {
       return ret;
     }
@@ -96,6 +113,104 @@ public:
     return codec->encode(outPixel, encodeCb);
   }
 
+  // Same pipeline as processImage, but every blocking step runs as a separate executor task, so the worker goes
+  // through other requests between the steps, and waiting for a free processor parks the request on the executor
+  // timer instead of failing.
+  // The token is checked between the steps and by the processor between its tiles.
+  // With a resource scheduler set, decode and encode take a CPU slot and inference takes a device slot and memory.
+  template <typename Executor>
+  tp::CoTask<liret> processImageAsync(Executor &executor, ImageTask input, ProgressCallback procb = [](float val) {},
+                                      CancellationToken token = CancellationToken()) {
+    uint8_t *inImage = nullptr;
+    size_t size = 0;
+
+    // Repository calls block on I/O, the pool compensates for the blocked worker
+    liret ret = co_await tp::offload(executor, [this, &executor, &input, &inImage, &size]() {
+      return executor.blocking(
+          [&]() { return m_mediaRepo.getImageById(input.imageId.c_str(), input.imageId.size(), &inImage, &size); });
+    });
+    if (ret != liret::kOk) {
+      co_return ret;
+    }
+    std::unique_ptr<uint8_t[]> inImageData(inImage);
+    if (token.isCancelled()) {
+      co_return liret::kCancelled;
+    }
+
+    image::Container inPixel;
+    auto codecFactory = image::CodecFactory::getInstance();
+
+    std::span<image::EncodedDataType> imageSpan{inImage, size};
+    auto codec = codecFactory->acquireFromData(imageSpan);
+    tp::ResourceGrant resources = co_await acquireResources(executor, {.cpu = 1});
+    ret = codec->decode(imageSpan, inPixel);
+    resources.release();
+    if (ret != liret::kOk) {
+      co_return ret;
+    }
+
+    auto container = getContainer(input.modelId);
+    if (!container) {
+      co_return liret::kAborted;
+    }
+
+    // Containers don't signal returned processors, so the wait polls with growing pauses, holding no worker and no
+    // scheduler resources meanwhile
+    auto procDeleter = [&container](ImageProcessor *ptr) { container->reclaimProcessor(ptr); };
+    std::unique_ptr<ImageProcessor, decltype(procDeleter)> processor(container->tryAcquireProcessor(), procDeleter);
+    const auto deadline = std::chrono::steady_clock::now() + g_processorWaitTimeout;
+    std::chrono::milliseconds retryDelay(1);
+    while (!processor && std::chrono::steady_clock::now() < deadline && !token.isCancelled()) {
+      co_await executor.scheduleAfter(retryDelay);
+      retryDelay = std::min(retryDelay * 2, g_processorRetryMaxDelay);
+      processor.reset(container->tryAcquireProcessor());
+    }
+    if (token.isCancelled()) {
+      co_return liret::kCancelled;
+    }
+    if (!processor) {
+      co_return liret::kAborted;
+    }
+
+    const size_t inSize = size_t(inPixel.w) * inPixel.h * inPixel.c;
+    resources = co_await acquireResources(executor, {.inference = 1, .memory = inSize * g_inferenceMemoryFactor});
+
+    ImageInfo inImageInfo{.data = inPixel.data.get(), .w = inPixel.w, .h = inPixel.h, .c = inPixel.c};
+    ImageInfo outImageInfo;
+    ret = co_await tp::offload(executor, [&processor, &inImageInfo, &outImageInfo, &procb, &token]() {
+      return processor->process_image(inImageInfo, outImageInfo, procb, token);
+    });
+    if (ret != liret::kOk) {
+      co_return ret;
+    }
+    processor.reset();
+    resources.release();
+
+    image::Container outPixel{
+        .data = image::ContainerData(outImageInfo.data, [](image::ContainerDataType *ptr) { delete[] ptr; }),
+        .size = outImageInfo.size,
+        .w = outImageInfo.w,
+        .h = outImageInfo.h,
+        .c = outImageInfo.c};
+
+    const auto encodeCb = [this, &executor, &input](image::EncodeData data, size_t size) {
+      return executor.blocking(
+          [&]() { return m_mediaRepo.updateImageById(input.imageId.c_str(), input.imageId.size(), data.get(), size); });
+    };
+
+    using CodecType = limb::image::CodecType;
+    if (outPixel.c == 4 && codec->type() == CodecType::kJpg) {
+      codec = codecFactory->acquireFromType(CodecType::kPng);
+    }
+
+    resources = co_await acquireResources(executor, {.cpu = 1});
+    co_return co_await tp::offload(executor,
+                                   [&codec, &outPixel, &encodeCb]() { return codec->encode(outPixel, encodeCb); });
+  }
+
+  // Scheduler used by processImageAsync to bound its stages, it must outlive the running requests
+  void setResourceScheduler(tp::ResourceScheduler *scheduler) { m_scheduler = scheduler; }
+
   virtual size_t processorCount() { return m_processorProvider.processorCount(); }
 
   using reclaim = std::function<void(ProcessorContainer *)>;
@@ -115,9 +230,21 @@ public:
   virtual void clear() { m_processorProvider.clear(); }
 
 private:
+  // Takes nothing unless a resource scheduler is set
+  template <typename Executor>
+  tp::CoTask<tp::ResourceGrant> acquireResources(Executor &executor, tp::ResourceRequest request) {
+    tp::ResourceGrant grant;
+    if (m_scheduler) {
+      grant = co_await m_scheduler->acquire(executor, request);
+    }
+    co_return grant;
+  }
+
   ProcessorInitializer<ProcessorStorage> m_processorProvider;
 
   Repo m_mediaRepo;
+
+  tp::ResourceScheduler *m_scheduler = nullptr;
 };
 } // namespace limb
 
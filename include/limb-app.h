@@ -9,6 +9,7 @@
 #include "capabilities-provider.h"
 #include "image-service/image-service.hpp"
 #include "processor-loader.h"
+#include "thread-pool/thread-pool.hpp"
 #include "utils/callbacks.h"
 
 namespace limb {
@@ -18,7 +19,12 @@ public:
   virtual ~AppBase() = default;
   virtual liret init() = 0;
   virtual void deinit() = 0;
-  virtual liret processImage(const ImageTask &, const ProgressCallback && = [](float val) {}) = 0;
+  virtual liret processImage(const ImageTask &, const ProgressCallback && = [](float val) {},
+                             const CancellationToken & = defaultCancellationToken) = 0;
+  // Coroutine version of processImage, its steps run as separate tasks of the pool
+  virtual tp::CoTask<liret> processImageAsync(tp::ThreadPool &pool, const ImageTask &,
+                                              ProgressCallback = [](float val) {},
+                                              CancellationToken = CancellationToken()) = 0;
   virtual AppInfoTask getAppInfo() = 0;
 
   virtual size_t processorCount() const = 0;
@@ -79,8 +85,13 @@ public:
     m_mediaService.clear();
   }
 
-  liret processImage(const ImageTask &input, const ProgressCallback &&procb) override {
-    return m_mediaService.processImage(input, ProgressCallback(procb));
+  liret processImage(const ImageTask &input, const ProgressCallback &&procb, const CancellationToken &token) override {
+    return m_mediaService.processImage(input, ProgressCallback(procb), token);
+  }
+
+  tp::CoTask<liret> processImageAsync(tp::ThreadPool &pool, const ImageTask &input, ProgressCallback procb,
+                                      CancellationToken token) override {
+    return m_mediaService.processImageAsync(pool, input, std::move(procb), std::move(token));
   }
 
   AppInfoTask getAppInfo() override { return m_capProvider.getAppInfo(); }
@@ -25,8 +25,11 @@ public:
   // Get the processor's name used to distinguish it from other processors
   virtual std::string_view name() const = 0;
 
+  // Cancellable processors check the token between units of work (e.g. tiles) and return kCancelled, leaving
+  // outimage empty
   virtual liret process_image(const ImageInfo &inimage, ImageInfo &outimage,
-                              const ProgressCallback &procb = defaultProgressCallback) const = 0;
+                              const ProgressCallback &procb = defaultProgressCallback,
+                              const CancellationToken &token = defaultCancellationToken) const = 0;
 };
 
 // Class responsible for providing media processors
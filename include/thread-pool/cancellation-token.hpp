@@ -0,0 +1,103 @@
+#pragma once
+
+#include <thread-pool/thread-pool-stats.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+namespace limb {
+namespace tp {
+
+namespace detail {
+struct CancellationState {
+  CancellationState() : cancelled(false), deadline(0) {}
+
+  std::atomic<bool> cancelled;
+  /// Monotonic nanoseconds, 0 means no deadline.
+  std::atomic<uint64_t> deadline;
+};
+} // namespace detail
+
+/**
+ * @brief The CancellationToken class lets a task observe a cancellation
+ * request. Cancellation is cooperative: the task carries the token and checks
+ * isCancelled() at points where it is safe to stop. Default constructed token
+ * is never cancelled. Copies are cheap and share the state of the source.
+ */
+class CancellationToken {
+public:
+  CancellationToken() = default;
+
+  /**
+   * @brief isCancelled Check whether cancellation was requested or deadline
+   * has passed.
+   */
+  bool isCancelled() const noexcept;
+
+  /**
+   * @brief canBeCancelled Check whether token is bound to a source.
+   */
+  bool canBeCancelled() const noexcept { return m_state != nullptr; }
+
+private:
+  friend class CancellationSource;
+
+  explicit CancellationToken(std::shared_ptr<detail::CancellationState> state) : m_state(std::move(state)) {}
+
+  std::shared_ptr<detail::CancellationState> m_state;
+};
+
+/**
+ * @brief The CancellationSource class issues tokens and trips them.
+ */
+class CancellationSource {
+public:
+  CancellationSource() : m_state(std::make_shared<detail::CancellationState>()) {}
+
+  /**
+   * @brief token Return token observing this source.
+   */
+  CancellationToken token() const { return CancellationToken(m_state); }
+
+  /**
+   * @brief cancel Request cancellation, any thread.
+   */
+  void cancel() noexcept { m_state->cancelled.store(true, std::memory_order_release); }
+
+  /**
+   * @brief cancelAfter Request cancellation once timeout expires.
+   */
+  template <typename Rep, typename Period> void cancelAfter(const std::chrono::duration<Rep, Period> &timeout);
+
+  /**
+   * @brief isCancelled Check whether tokens of this source are cancelled.
+   */
+  bool isCancelled() const noexcept { return token().isCancelled(); }
+
+private:
+  std::shared_ptr<detail::CancellationState> m_state;
+};
+
+/// Implementation
+
+inline bool CancellationToken::isCancelled() const noexcept {
+  if (!m_state) {
+    return false;
+  }
+  if (m_state->cancelled.load(std::memory_order_acquire)) {
+    return true;
+  }
+  const uint64_t deadline = m_state->deadline.load(std::memory_order_relaxed);
+  return deadline != 0 && detail::monotonicNs() >= deadline;
+}
+
+template <typename Rep, typename Period>
+inline void CancellationSource::cancelAfter(const std::chrono::duration<Rep, Period> &timeout) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+  m_state->deadline.store(detail::monotonicNs() + uint64_t(ns > 0 ? ns : 1), std::memory_order_relaxed);
+}
+
+} // namespace tp
+} // namespace limb
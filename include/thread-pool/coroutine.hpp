@@ -0,0 +1,316 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+namespace limb {
+namespace tp {
+
+/**
+ * @brief The FramePool class implements allocator for coroutine frames.
+ * Frames are rounded up to power of 2 size classes and cached in thread
+ * local free lists, so steady state coroutine creation does not touch the
+ * global heap. A frame may be freed by a thread other than the one which
+ * allocated it, then it goes to the freeing thread's cache.
+ */
+class FramePool {
+public:
+  static constexpr size_t MIN_BLOCK_SIZE = 64;
+  static constexpr size_t CLASS_COUNT = 8;
+  /// Frames larger than that go straight to the global heap.
+  static constexpr size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (CLASS_COUNT - 1);
+  /// Number of free blocks kept by every thread in every size class.
+  static constexpr size_t CACHE_SIZE = 64;
+
+  /**
+   * @brief allocate Allocate frame.
+   * @param size Frame size.
+   * @throws std::bad_alloc
+   */
+  static void *allocate(size_t size);
+
+  /**
+   * @brief deallocate Free frame taken with allocate().
+   * @param size Same size as passed to allocate().
+   */
+  static void deallocate(void *ptr, size_t size) noexcept;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct Cache {
+    ~Cache();
+
+    std::array<FreeBlock *, CLASS_COUNT> heads{};
+    std::array<size_t, CLASS_COUNT> counts{};
+  };
+
+  static size_t classIndex(size_t size);
+  static Cache *cache();
+};
+
+template <typename T = void> class CoTask;
+
+namespace detail {
+
+struct CoPromiseBase {
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise> std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      CoPromiseBase &promise = h.promise();
+      if (promise.continuation) {
+        return promise.continuation;
+      }
+      if (promise.detached) {
+        h.destroy();
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  static void *operator new(size_t size) { return FramePool::allocate(size); }
+
+  static void operator delete(void *ptr, size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+
+  std::coroutine_handle<> continuation;
+  bool detached = false;
+  std::exception_ptr error;
+};
+
+template <typename T> struct CoPromise : CoPromiseBase {
+  CoPromise() = default;
+
+  ~CoPromise() {
+    if (has_value) {
+      std::launder(reinterpret_cast<T *>(&value))->~T();
+    }
+  }
+
+  template <typename U> void return_value(U &&result) {
+    new (&value) T(std::forward<U>(result));
+    has_value = true;
+  }
+
+  T result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return std::move(*std::launder(reinterpret_cast<T *>(&value)));
+  }
+
+  bool has_value = false;
+  alignas(T) unsigned char value[sizeof(T)];
+};
+
+template <> struct CoPromise<void> : CoPromiseBase {
+  void return_void() noexcept {}
+
+  void result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief The CoTask class is a lazily started coroutine returning T.
+ * It starts when awaited and resumes the awaiting coroutine when done, on
+ * the thread which completed it. Frames come from FramePool.
+ * A task which nobody awaits may be detached: it starts on the current thread
+ * and destroys itself on completion, exceptions escaping it are suppressed.
+ */
+template <typename T> class [[nodiscard]] CoTask {
+public:
+  struct promise_type : detail::CoPromise<T> {
+    CoTask get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+  };
+
+  CoTask(CoTask &&rhs) noexcept : m_handle(std::exchange(rhs.m_handle, nullptr)) {}
+
+  CoTask &operator=(CoTask &&rhs) noexcept {
+    if (this != &rhs) {
+      reset();
+      m_handle = std::exchange(rhs.m_handle, nullptr);
+    }
+    return *this;
+  }
+
+  ~CoTask() { reset(); }
+
+  bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+  }
+
+  T await_resume() { return m_handle.promise().result(); }
+
+  /**
+   * @brief detach Start the task on the current thread and give up its
+   * ownership.
+   */
+  void detach() && {
+    std::coroutine_handle<promise_type> handle = release();
+    handle.resume();
+  }
+
+  /**
+   * @brief release Give up ownership of the not yet started task, it
+   * destroys itself on completion.
+   * @return Handle to be resumed to start the task.
+   */
+  std::coroutine_handle<promise_type> release() {
+    m_handle.promise().detached = true;
+    return std::exchange(m_handle, nullptr);
+  }
+
+private:
+  explicit CoTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+  CoTask(const CoTask &) = delete;
+  CoTask &operator=(const CoTask &) = delete;
+
+  void reset() {
+    if (m_handle) {
+      m_handle.destroy();
+      m_handle = nullptr;
+    }
+  }
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * @brief The ScheduleAwaiter class moves awaiting coroutine to a pool
+ * worker. The coroutine handle is posted as is: it fits into the task
+ * storage, so no allocation happens. If the pool queues are full the
+ * coroutine continues on the current thread.
+ */
+template <typename Pool> class ScheduleAwaiter {
+public:
+  ScheduleAwaiter(Pool &pool, size_t lane) : m_pool(pool), m_lane(lane) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> awaiting) { return m_pool.tryPost(awaiting, m_lane); }
+
+  void await_resume() const noexcept {}
+
+private:
+  Pool &m_pool;
+  size_t m_lane;
+};
+
+/**
+ * @brief The DelayAwaiter class resumes awaiting coroutine on a pool worker
+ * once the delay expires. The coroutine is kept by the pool timer meanwhile,
+ * so it holds no worker. If the pool is destroyed first the coroutine is
+ * never resumed.
+ */
+template <typename Pool> class DelayAwaiter {
+public:
+  DelayAwaiter(Pool &pool, std::chrono::steady_clock::duration delay, size_t lane)
+      : m_pool(pool), m_delay(delay), m_lane(lane) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> awaiting) { m_pool.postAfter(m_delay, awaiting, m_lane); }
+
+  void await_resume() const noexcept {}
+
+private:
+  Pool &m_pool;
+  std::chrono::steady_clock::duration m_delay;
+  size_t m_lane;
+};
+
+/**
+ * @brief offload Run blocking call as a separate task of the executor.
+ * The awaiting coroutine gives up its worker until the call is done and
+ * resumes on the thread which made it.
+ * @param executor Any object with 'schedule(lane)' returning awaitable.
+ * @param fn Callable as 'fn()'.
+ * @param lane Priority lane, the lowest priority one by default.
+ */
+template <typename Executor, typename Fn>
+CoTask<std::invoke_result_t<Fn &>> offload(Executor &executor, Fn fn, size_t lane = size_t(-1)) {
+  co_await executor.schedule(lane);
+  co_return fn();
+}
+
+/// Implementation
+
+inline size_t FramePool::classIndex(size_t size) {
+  size_t index = 0;
+  while ((MIN_BLOCK_SIZE << index) < size) {
+    ++index;
+  }
+  return index;
+}
+
+inline FramePool::Cache *FramePool::cache() {
+  // Frames may be freed after the cache is destroyed at thread exit, the
+  // trivially destructible flag stays readable
+  static thread_local bool destroyed = false;
+  struct Guard {
+    ~Guard() { destroyed = true; }
+    Cache cache;
+  };
+  static thread_local Guard guard;
+  return destroyed ? nullptr : &guard.cache;
+}
+
+inline FramePool::Cache::~Cache() {
+  for (FreeBlock *&head : heads) {
+    while (head) {
+      ::operator delete(std::exchange(head, head->next));
+    }
+  }
+}
+
+inline void *FramePool::allocate(size_t size) {
+  if (size > MAX_BLOCK_SIZE) {
+    return ::operator new(size);
+  }
+
+  const size_t index = classIndex(size);
+  if (Cache *c = cache(); c && c->heads[index]) {
+    --c->counts[index];
+    return std::exchange(c->heads[index], c->heads[index]->next);
+  }
+  return ::operator new(MIN_BLOCK_SIZE << index);
+}
+
+inline void FramePool::deallocate(void *ptr, size_t size) noexcept {
+  if (size <= MAX_BLOCK_SIZE) {
+    const size_t index = classIndex(size);
+    if (Cache *c = cache(); c && c->counts[index] < CACHE_SIZE) {
+      c->heads[index] = new (ptr) FreeBlock{c->heads[index]};
+      ++c->counts[index];
+      return;
+    }
+  }
+  ::operator delete(ptr);
+}
+
+} // namespace tp
+} // namespace limb
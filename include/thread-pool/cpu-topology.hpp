@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+namespace limb {
+namespace tp {
+
+/**
+ * @brief The WorkerPlacement enum selects how workers are pinned to CPUs.
+ */
+enum class WorkerPlacement {
+  /// Workers are not pinned, or pinned to the whole CPU set if one is given.
+  kNone,
+  /// Workers fill NUMA nodes one after another.
+  kCompact,
+  /// Workers are distributed over NUMA nodes round-robin.
+  kSpread
+};
+
+/**
+ * @brief The CpuTopology class describes which CPUs belong to which NUMA
+ * node and computes worker placement.
+ * On Linux it is read from sysfs, elsewhere all CPUs are reported as a
+ * single node.
+ */
+class CpuTopology {
+public:
+  /**
+   * @brief CpuTopology Construct topology from list of CPUs of every node.
+   */
+  explicit CpuTopology(std::vector<std::vector<size_t>> nodes);
+
+  /**
+   * @brief detect Read topology of current machine.
+   */
+  static CpuTopology detect();
+
+  /**
+   * @brief nodes Return CPUs of every NUMA node.
+   */
+  const std::vector<std::vector<size_t>> &nodes() const;
+
+  /**
+   * @brief place Compute CPU sets for workers.
+   * @param worker_count Number of workers.
+   * @param placement Placement strategy.
+   * @param cpu_set CPUs workers may run on, empty means all of them.
+   * @return CPU set of every worker, empty set means worker is not pinned.
+   */
+  std::vector<std::vector<size_t>> place(size_t worker_count, WorkerPlacement placement,
+                                         const std::vector<size_t> &cpu_set) const;
+
+  /**
+   * @brief parseCpuList Parse CPU list in sysfs format, e.g. "0-3,8,10-11".
+   */
+  static std::vector<size_t> parseCpuList(const std::string &list);
+
+private:
+  std::vector<std::vector<size_t>> m_nodes;
+};
+
+/**
+ * @brief pinCurrentThread Restrict current thread to given CPUs.
+ * @param cpus CPU set, must not be empty.
+ * @return 'true' on success, false if pinning failed or is not supported.
+ */
+inline bool pinCurrentThread(const std::vector<size_t> &cpus);
+
+/// Implementation
+
+inline CpuTopology::CpuTopology(std::vector<std::vector<size_t>> nodes) : m_nodes(std::move(nodes)) {}
+
+inline CpuTopology CpuTopology::detect() {
+  std::vector<std::vector<size_t>> nodes;
+
+#if defined(__linux__)
+  // Node numbers may have gaps, give up after a few missing ones
+  for (size_t node = 0, missing = 0; missing < 8; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!file) {
+      ++missing;
+      continue;
+    }
+    std::string list;
+    std::getline(file, list);
+    auto cpus = parseCpuList(list);
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+#endif
+
+  if (nodes.empty()) {
+    std::vector<size_t> cpus(std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      cpus[i] = i;
+    }
+    nodes.push_back(std::move(cpus));
+  }
+
+  return CpuTopology(std::move(nodes));
+}
+
+inline const std::vector<std::vector<size_t>> &CpuTopology::nodes() const { return m_nodes; }
+
+inline std::vector<std::vector<size_t>> CpuTopology::place(size_t worker_count, WorkerPlacement placement,
+                                                           const std::vector<size_t> &cpu_set) const {
+  std::vector<std::vector<size_t>> result(worker_count);
+
+  std::vector<std::vector<size_t>> allowed;
+  for (const auto &node : m_nodes) {
+    std::vector<size_t> cpus;
+    for (size_t cpu : node) {
+      if (cpu_set.empty() || std::find(cpu_set.begin(), cpu_set.end(), cpu) != cpu_set.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      allowed.push_back(std::move(cpus));
+    }
+  }
+
+  if (allowed.empty()) {
+    return result;
+  }
+
+  if (placement == WorkerPlacement::kNone) {
+    if (!cpu_set.empty()) {
+      std::vector<size_t> all;
+      for (const auto &node : allowed) {
+        all.insert(all.end(), node.begin(), node.end());
+      }
+      std::fill(result.begin(), result.end(), all);
+    }
+    return result;
+  }
+
+  std::vector<size_t> order;
+  if (placement == WorkerPlacement::kCompact) {
+    for (const auto &node : allowed) {
+      order.insert(order.end(), node.begin(), node.end());
+    }
+  } else {
+    size_t longest = 0;
+    for (const auto &node : allowed) {
+      longest = std::max(longest, node.size());
+    }
+    for (size_t i = 0; i < longest; ++i) {
+      for (const auto &node : allowed) {
+        if (i < node.size()) {
+          order.push_back(node[i]);
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < worker_count; ++i) {
+    result[i].push_back(order[i % order.size()]);
+  }
+  return result;
+}
+
+inline std::vector<size_t> CpuTopology::parseCpuList(const std::string &list) {
+  std::vector<size_t> cpus;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    size_t first = 0, last = 0;
+    const auto dash = range.find('-');
+    try {
+      first = std::stoul(range.substr(0, dash));
+      last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+    } catch (const std::exception &) {
+      continue;
+    }
+    for (size_t cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+inline bool pinCurrentThread(const std::vector<size_t> &cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return !cpus.empty() && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (size_t cpu : cpus) {
+    if (cpu < sizeof(mask) * 8) {
+      mask |= DWORD_PTR(1) << cpu;
+    }
+  }
+  return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+} // namespace tp
+} // namespace limb
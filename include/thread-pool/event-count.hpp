@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+namespace limb {
+namespace tp {
+
+/**
+ * @brief cpuRelax Hint processor that caller is spinning.
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief The EventCount class implements condition variable for lock-free
+ * algorithms.
+ * Waiter announces itself with prepareWait(), re-checks its condition and
+ * either cancels with cancelWait() or parks with wait(). Notifier publishes
+ * the state change and calls notify(), which does nothing (and makes no
+ * syscall) when nobody is parked.
+ * Parking is based on std::atomic::wait, i.e. futex on Linux and
+ * WaitOnAddress on Windows.
+ */
+class EventCount {
+public:
+  using Key = uint32_t;
+
+  EventCount() : m_epoch(0), m_waiters(0) {}
+
+  /**
+   * @brief prepareWait Register caller as a waiter.
+   * @return Key to be passed to wait().
+   */
+  Key prepareWait();
+
+  /**
+   * @brief cancelWait Unregister caller, when condition became true after
+   * prepareWait().
+   */
+  void cancelWait();
+
+  /**
+   * @brief wait Park until notify() is called after prepareWait().
+   * @param key Value returned by prepareWait().
+   */
+  void wait(Key key);
+
+  /**
+   * @brief notify Wake one parked waiter, if any.
+   */
+  void notify();
+
+  /**
+   * @brief notifyN Wake up to count parked waiters.
+   */
+  void notifyN(size_t count);
+
+  /**
+   * @brief notifyAll Wake all parked waiters.
+   */
+  void notifyAll();
+
+private:
+  EventCount(const EventCount &) = delete;
+  EventCount &operator=(const EventCount &) = delete;
+
+  typedef char Cacheline[64];
+
+  std::atomic<Key> m_epoch;
+  std::atomic<uint32_t> m_waiters;
+  Cacheline pad0;
+};
+
+/// Implementation
+
+inline EventCount::Key EventCount::prepareWait() {
+  m_waiters.fetch_add(1, std::memory_order_seq_cst);
+  return m_epoch.load(std::memory_order_acquire);
+}
+
+inline void EventCount::cancelWait() { m_waiters.fetch_sub(1, std::memory_order_relaxed); }
+
+inline void EventCount::wait(Key key) {
+  m_epoch.wait(key, std::memory_order_acquire);
+  m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void EventCount::notify() {
+  // Pairs with the seq_cst increment in prepareWait(): either the waiter sees
+  // the published state, or we see the waiter.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_waiters.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  m_epoch.fetch_add(1, std::memory_order_release);
+  m_epoch.notify_one();
+}
+
+inline void EventCount::notifyN(size_t count) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const uint32_t waiters = m_waiters.load(std::memory_order_relaxed);
+  if (waiters == 0 || count == 0) {
+    return;
+  }
+  m_epoch.fetch_add(1, std::memory_order_release);
+  if (count >= waiters) {
+    m_epoch.notify_all();
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    m_epoch.notify_one();
+  }
+}
+
+inline void EventCount::notifyAll() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  m_epoch.fetch_add(1, std::memory_order_release);
+  m_epoch.notify_all();
+}
+
+} // namespace tp
+} // namespace limb
@@ -15,10 +15,17 @@ namespace tp {
  *  - The size of functional objects is limited to storage size.
  * Due to limitations above it is much faster on creation and copying than
  * std::function.
+ * OVERSIZE_POLICY selects what happens to functional objects which don't fit
+ * into the storage: InplaceOnly rejects them at compile time, HeapFallback
+ * stores them on the heap.
  */
-template <typename SIGNATURE, size_t STORAGE_SIZE = 128> class FixedFunction;
+struct InplaceOnly {};
+struct HeapFallback {};
 
-template <typename R, typename... ARGS, size_t STORAGE_SIZE> class FixedFunction<R(ARGS...), STORAGE_SIZE> {
+template <typename SIGNATURE, size_t STORAGE_SIZE = 128, typename OVERSIZE_POLICY = InplaceOnly> class FixedFunction;
+
+template <typename R, typename... ARGS, size_t STORAGE_SIZE, typename OVERSIZE_POLICY>
+class FixedFunction<R(ARGS...), STORAGE_SIZE, OVERSIZE_POLICY> {
 
   typedef R (*func_ptr_type)(ARGS...);
 
@@ -29,27 +36,52 @@ public:
    * @brief FixedFunction Constructor from functional object.
    * @param object Functor object will be stored in the internal storage
    * using move constructor. Unmovable objects are prohibited explicitly.
+   * With HeapFallback policy objects which don't fit into the storage are
+   * moved to the heap.
    */
   template <typename FUNC> FixedFunction(FUNC &&object) : FixedFunction() {
     typedef typename std::remove_reference<FUNC>::type unref_type;
 
-    static_assert(sizeof(unref_type) < STORAGE_SIZE, "functional object doesn't fit into internal storage");
     static_assert(std::is_move_constructible<unref_type>::value, "Should be of movable type");
 
-    m_method_ptr = [](void *object_ptr, func_ptr_type, ARGS... args) -> R {
-      return static_cast<unref_type *>(object_ptr)->operator()(args...);
-    };
+    constexpr bool fits = sizeof(unref_type) < STORAGE_SIZE && alignof(unref_type) <= alignof(storage_type);
 
-    m_alloc_ptr = [](void *storage_ptr, void *object_ptr) {
-      if (object_ptr) {
-        unref_type *x_object = static_cast<unref_type *>(object_ptr);
-        new (storage_ptr) unref_type(std::move(*x_object));
-      } else {
-        static_cast<unref_type *>(storage_ptr)->~unref_type();
-      }
-    };
+    if constexpr (fits || !std::is_same<OVERSIZE_POLICY, HeapFallback>::value) {
+      static_assert(sizeof(unref_type) < STORAGE_SIZE, "functional object doesn't fit into internal storage");
+
+      m_method_ptr = [](void *object_ptr, func_ptr_type, ARGS... args) -> R {
+        return static_cast<unref_type *>(object_ptr)->operator()(args...);
+      };
 
-    m_alloc_ptr(&m_storage, &object);
+      m_alloc_ptr = [](void *storage_ptr, void *object_ptr) {
+        if (object_ptr) {
+          unref_type *x_object = static_cast<unref_type *>(object_ptr);
+          new (storage_ptr) unref_type(std::move(*x_object));
+        } else {
+          static_cast<unref_type *>(storage_ptr)->~unref_type();
+        }
+      };
+
+      m_alloc_ptr(&m_storage, &object);
+    } else {
+      // The storage keeps pointer to the heap object, moves just steal it.
+      m_method_ptr = [](void *object_ptr, func_ptr_type, ARGS... args) -> R {
+        return (*static_cast<unref_type **>(object_ptr))->operator()(args...);
+      };
+
+      m_alloc_ptr = [](void *storage_ptr, void *object_ptr) {
+        unref_type **x_storage = static_cast<unref_type **>(storage_ptr);
+        if (object_ptr) {
+          unref_type **x_object = static_cast<unref_type **>(object_ptr);
+          *x_storage = *x_object;
+          *x_object = nullptr;
+        } else {
+          delete *x_storage;
+        }
+      };
+
+      *reinterpret_cast<unref_type **>(&m_storage) = new unref_type(std::move(object));
+    }
   }
 
   /**
@@ -88,8 +120,10 @@ private:
   FixedFunction &operator=(const FixedFunction &) = delete;
   FixedFunction(const FixedFunction &) = delete;
 
+  typedef typename std::aligned_storage<STORAGE_SIZE, sizeof(size_t)>::type storage_type;
+
   union {
-    typename std::aligned_storage<STORAGE_SIZE, sizeof(size_t)>::type m_storage;
+    storage_type m_storage;
     func_ptr_type m_function_ptr;
   };
 
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <thread-pool/limb-queue.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+namespace limb {
+namespace tp {
+
+/**
+ * @brief The FutureSlab class implements fixed-size block allocator for
+ * future shared states.
+ * Blocks are preallocated at construction and recycled through lock-free
+ * free list, so steady state submission does not allocate.
+ * The slab is reference counted: it is destroyed when its owner released it
+ * and all blocks are returned.
+ */
+class FutureSlab {
+public:
+  static constexpr size_t BLOCK_SIZE = 128;
+
+  /**
+   * @brief create Allocate new slab, owned by the caller.
+   * @param count Number of blocks, rounded up to a power of 2.
+   */
+  static FutureSlab *create(size_t count);
+
+  /**
+   * @brief allocate Take free block.
+   * @return Block of BLOCK_SIZE bytes or nullptr if slab is exhausted.
+   */
+  void *allocate();
+
+  /**
+   * @brief deallocate Return block taken with allocate().
+   */
+  void deallocate(void *block);
+
+  /**
+   * @brief release Drop owner reference.
+   */
+  void release();
+
+private:
+  explicit FutureSlab(size_t count);
+
+  FutureSlab(const FutureSlab &) = delete;
+  FutureSlab &operator=(const FutureSlab &) = delete;
+
+  void unref();
+
+  struct alignas(std::max_align_t) Block {
+    unsigned char data[BLOCK_SIZE];
+  };
+
+  std::unique_ptr<Block[]> m_blocks;
+  MPMCBoundedQueue<Block *> m_free;
+  std::atomic<size_t> m_refs;
+};
+
+namespace detail {
+
+/**
+ * @brief The FutureState struct holds result of a submitted task.
+ * It is shared by Future and the task: one reference each.
+ */
+template <typename T> struct FutureState {
+  enum Status : uint32_t { kPending = 0, kReady = 1, kPendingWaited = 2 };
+
+  using ValueStorage = std::conditional_t<std::is_void_v<T>, char, T>;
+
+  explicit FutureState(FutureSlab *slab) : refs(2), status(kPending), has_value(false), slab(slab) {}
+
+  ~FutureState() {
+    if constexpr (!std::is_void_v<T>) {
+      if (has_value) {
+        std::launder(reinterpret_cast<T *>(&value))->~T();
+      }
+    }
+  }
+
+  /**
+   * @brief create Allocate state from slab if it fits there, from heap
+   * otherwise.
+   */
+  static FutureState *create(FutureSlab *slab) {
+    if constexpr (sizeof(FutureState) <= FutureSlab::BLOCK_SIZE && alignof(FutureState) <= alignof(std::max_align_t)) {
+      if (slab) {
+        if (void *block = slab->allocate()) {
+          return new (block) FutureState(slab);
+        }
+      }
+    }
+    return new FutureState(nullptr);
+  }
+
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    if (FutureSlab *owner = slab) {
+      this->~FutureState();
+      owner->deallocate(this);
+    } else {
+      delete this;
+    }
+  }
+
+  template <typename F> void run(F &fn) {
+    try {
+      if constexpr (std::is_void_v<T>) {
+        fn();
+      } else {
+        new (&value) T(fn());
+        has_value = true;
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+    publish();
+  }
+
+  void fail(std::exception_ptr e) {
+    error = std::move(e);
+    publish();
+  }
+
+  void publish() {
+    if (status.exchange(kReady, std::memory_order_acq_rel) == kPendingWaited) {
+      status.notify_all();
+    }
+  }
+
+  void wait() {
+    uint32_t current = status.load(std::memory_order_acquire);
+    while (current != kReady) {
+      if (current == kPending && !status.compare_exchange_weak(current, kPendingWaited, std::memory_order_acq_rel,
+                                                               std::memory_order_acquire)) {
+        continue;
+      }
+      status.wait(kPendingWaited, std::memory_order_acquire);
+      current = status.load(std::memory_order_acquire);
+    }
+  }
+
+  std::atomic<uint32_t> refs;
+  std::atomic<uint32_t> status;
+  bool has_value;
+  FutureSlab *slab;
+  std::exception_ptr error;
+  alignas(ValueStorage) unsigned char value[sizeof(ValueStorage)];
+};
+
+/**
+ * @brief The FutureTask class is the functional object posted to the pool by
+ * submit(). If it is destroyed without being run, the future is completed
+ * with broken_promise error.
+ */
+template <typename T, typename F> class FutureTask {
+public:
+  FutureTask(FutureState<T> *state, F &&fn) : m_state(state), m_fn(std::move(fn)) {}
+
+  FutureTask(FutureTask &&rhs) noexcept : m_state(rhs.m_state), m_fn(std::move(rhs.m_fn)) { rhs.m_state = nullptr; }
+
+  ~FutureTask() {
+    if (m_state) {
+      m_state->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+      m_state->release();
+    }
+  }
+
+  void operator()() {
+    FutureState<T> *state = m_state;
+    m_state = nullptr;
+    state->run(m_fn);
+    state->release();
+  }
+
+private:
+  FutureTask(const FutureTask &) = delete;
+  FutureTask &operator=(const FutureTask &) = delete;
+
+  FutureState<T> *m_state;
+  F m_fn;
+};
+
+} // namespace detail
+
+/**
+ * @brief The Future class provides access to result of a task submitted with
+ * ThreadPool::submit().
+ * Unlike std::future its shared state is taken from the pool's slab.
+ */
+template <typename T> class Future {
+public:
+  Future() : m_state(nullptr) {}
+
+  explicit Future(detail::FutureState<T> *state) : m_state(state) {}
+
+  Future(Future &&rhs) noexcept : m_state(rhs.m_state) { rhs.m_state = nullptr; }
+
+  Future &operator=(Future &&rhs) noexcept {
+    if (this != &rhs) {
+      reset();
+      m_state = rhs.m_state;
+      rhs.m_state = nullptr;
+    }
+    return *this;
+  }
+
+  ~Future() { reset(); }
+
+  /**
+   * @brief valid Check whether future refers to a shared state.
+   */
+  bool valid() const { return m_state != nullptr; }
+
+  /**
+   * @brief isReady Check whether result is available.
+   */
+  bool isReady() const {
+    return m_state && m_state->status.load(std::memory_order_acquire) == detail::FutureState<T>::kReady;
+  }
+
+  /**
+   * @brief wait Block until result is available.
+   */
+  void wait() const {
+    if (!m_state) {
+      throw std::future_error(std::future_errc::no_state);
+    }
+    m_state->wait();
+  }
+
+  /**
+   * @brief get Wait for result and return it. Future becomes invalid.
+   * @throws Exception thrown by the task.
+   */
+  T get() {
+    wait();
+    std::unique_ptr<detail::FutureState<T>, Releaser> state(m_state);
+    m_state = nullptr;
+
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+    if constexpr (!std::is_void_v<T>) {
+      return std::move(*std::launder(reinterpret_cast<T *>(&state->value)));
+    }
+  }
+
+private:
+  Future(const Future &) = delete;
+  Future &operator=(const Future &) = delete;
+
+  struct Releaser {
+    void operator()(detail::FutureState<T> *state) const { state->release(); }
+  };
+
+  void reset() {
+    if (m_state) {
+      m_state->release();
+      m_state = nullptr;
+    }
+  }
+
+  detail::FutureState<T> *m_state;
+};
+
+/// Implementation
+
+inline FutureSlab *FutureSlab::create(size_t count) {
+  size_t rounded = 2;
+  while (rounded < count) {
+    rounded <<= 1;
+  }
+  return new FutureSlab(rounded);
+}
+
+inline FutureSlab::FutureSlab(size_t count) : m_free(count), m_refs(1) {
+  m_blocks.reset(new Block[count]);
+  for (size_t i = 0; i < count; ++i) {
+    m_free.push(&m_blocks[i]);
+  }
+}
+
+inline void *FutureSlab::allocate() {
+  Block *block = nullptr;
+  if (!m_free.pop(block)) {
+    return nullptr;
+  }
+  m_refs.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+inline void FutureSlab::deallocate(void *block) {
+  m_free.push(static_cast<Block *>(block));
+  unref();
+}
+
+inline void FutureSlab::release() { unref(); }
+
+inline void FutureSlab::unref() {
+  if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+} // namespace tp
+} // namespace limb
@@ -77,6 +77,16 @@ public:
    */
   template <typename U> bool push(U &&data);
 
+  /**
+   * @brief pushN Push up to count elements to queue, reserving their cells
+   * with a single CAS.
+   * @param first Iterator to elements to be pushed, they are assigned to
+   * queue cells with 'cell = *first', use std::move_iterator to move them.
+   * @param count Number of elements.
+   * @return Number of pushed elements, the first ones of the range.
+   */
+  template <typename It> size_t pushN(It first, size_t count);
+
   /**
    * @brief pop Pop data from queue.
    * @param data Place to store popped data.
@@ -84,6 +94,25 @@ public:
    */
   bool pop(T &data);
 
+  /**
+   * @brief popN Pop up to count elements from queue, reserving their cells
+   * with a single CAS.
+   * @param out Output iterator, popped elements are moved to it.
+   * @param count Maximum number of elements.
+   * @return Number of popped elements.
+   */
+  template <typename It> size_t popN(It out, size_t count);
+
+  /**
+   * @brief size Approximate number of elements in the queue.
+   */
+  size_t size() const;
+
+  /**
+   * @brief capacity Maximum number of elements in the queue.
+   */
+  size_t capacity() const;
+
 private:
   struct Cell {
     std::atomic<size_t> sequence;
@@ -194,5 +223,95 @@ template <typename T> inline bool MPMCBoundedQueue<T>::pop(T &data) {
   return true;
 }
 
+template <typename T> template <typename It> inline size_t MPMCBoundedQueue<T>::pushN(It first, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  size_t reserved;
+  for (;;) {
+    // Consumers release cells out of order, so every cell of the range is checked
+    reserved = 0;
+    while (reserved < count && reserved <= m_buffer_mask) {
+      const size_t seq = m_buffer[(pos + reserved) & m_buffer_mask].sequence.load(std::memory_order_acquire);
+      if (seq != pos + reserved) {
+        break;
+      }
+      ++reserved;
+    }
+
+    if (reserved == 0) {
+      const size_t seq = m_buffer[pos & m_buffer_mask].sequence.load(std::memory_order_acquire);
+      if ((intptr_t)seq - (intptr_t)pos < 0) {
+        return 0;
+      }
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      continue;
+    }
+
+    if (m_enqueue_pos.compare_exchange_weak(pos, pos + reserved, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < reserved; ++i, ++first) {
+    Cell &cell = m_buffer[(pos + i) & m_buffer_mask];
+    cell.data = *first;
+    cell.sequence.store(pos + i + 1, std::memory_order_release);
+  }
+
+  return reserved;
+}
+
+template <typename T> template <typename It> inline size_t MPMCBoundedQueue<T>::popN(It out, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  size_t reserved;
+  for (;;) {
+    // Producers publish cells out of order, so every cell of the range is checked
+    reserved = 0;
+    while (reserved < count && reserved <= m_buffer_mask) {
+      const size_t seq = m_buffer[(pos + reserved) & m_buffer_mask].sequence.load(std::memory_order_acquire);
+      if (seq != pos + reserved + 1) {
+        break;
+      }
+      ++reserved;
+    }
+
+    if (reserved == 0) {
+      const size_t seq = m_buffer[pos & m_buffer_mask].sequence.load(std::memory_order_acquire);
+      if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+        return 0;
+      }
+      pos = m_dequeue_pos.load(std::memory_order_relaxed);
+      continue;
+    }
+
+    if (m_dequeue_pos.compare_exchange_weak(pos, pos + reserved, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < reserved; ++i, ++out) {
+    Cell &cell = m_buffer[(pos + i) & m_buffer_mask];
+    *out = std::move(cell.data);
+    cell.sequence.store(pos + i + m_buffer_mask + 1, std::memory_order_release);
+  }
+
+  return reserved;
+}
+
+template <typename T> inline size_t MPMCBoundedQueue<T>::size() const {
+  const size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  const size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0u;
+}
+
+template <typename T> inline size_t MPMCBoundedQueue<T>::capacity() const { return m_buffer_mask + 1; }
+
 } // namespace tp
 } // namespace limb
\ No newline at end of file
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+namespace limb {
+namespace tp {
+
+class ResourceScheduler;
+
+/**
+ * @brief The ResourceRequest struct describes what a pipeline stage needs.
+ * Device memory is taken from the chosen device, requests larger than the
+ * device budget are clamped to it, so they run alone instead of never.
+ */
+struct ResourceRequest {
+  static constexpr size_t ANY_DEVICE = size_t(-1);
+
+  size_t cpu = 0;
+  size_t inference = 0;
+  /// Bytes of device memory.
+  size_t memory = 0;
+  /// Device index, the least loaded one by default.
+  size_t device = ANY_DEVICE;
+};
+
+/**
+ * @brief The ResourceGrant class owns resources handed out by
+ * ResourceScheduler and returns them on destruction.
+ */
+class ResourceGrant {
+public:
+  ResourceGrant() = default;
+  ResourceGrant(ResourceGrant &&rhs) noexcept;
+  ResourceGrant &operator=(ResourceGrant &&rhs) noexcept;
+  ~ResourceGrant() { release(); }
+
+  /**
+   * @brief release Return resources before destruction.
+   */
+  void release() noexcept;
+
+  /**
+   * @brief device Return index of the granted device or
+   * ResourceRequest::ANY_DEVICE if the request needed none.
+   */
+  size_t device() const noexcept { return m_taken.device; }
+
+  explicit operator bool() const noexcept { return m_scheduler != nullptr; }
+
+private:
+  friend class ResourceScheduler;
+
+  ResourceGrant(const ResourceGrant &) = delete;
+  ResourceGrant &operator=(const ResourceGrant &) = delete;
+
+  ResourceScheduler *m_scheduler = nullptr;
+  ResourceRequest m_taken;
+};
+
+namespace detail {
+struct ResourceWaiter {
+  ResourceRequest request;
+  ResourceGrant *grant = nullptr;
+  void (*wake)(ResourceWaiter *) = nullptr;
+  ResourceWaiter *next = nullptr;
+};
+} // namespace detail
+
+/**
+ * @brief The ResourceScheduler class models the resources of the machine
+ * separately: CPU slots, inference slots of every device and device memory
+ * budget. Every stage acquires only what it needs, so CPU-bound work may
+ * saturate cores while inference stays bounded by the device capacity.
+ * A request is granted when all of its resources are free at once. Waiting
+ * coroutines are granted in first-fit order and resumed on the pool.
+ */
+class ResourceScheduler {
+public:
+  struct Device {
+    /// Number of inferences run by the device concurrently.
+    size_t inferenceSlots;
+    /// Bytes, zero means unlimited.
+    size_t memoryBudget;
+  };
+
+  template <typename Pool> class Awaiter;
+
+  /**
+   * @brief ResourceScheduler Construct scheduler.
+   * @param cpuSlots Number of CPU-bound stages run concurrently.
+   * @param devices Inference devices, a CPU-only machine describes its cores
+   * as a device.
+   * @throws std::invalid_argument if there are no CPU slots.
+   */
+  ResourceScheduler(size_t cpuSlots, std::vector<Device> devices);
+
+  ResourceScheduler(const ResourceScheduler &) = delete;
+  ResourceScheduler &operator=(const ResourceScheduler &) = delete;
+
+  /**
+   * @brief tryAcquire Take resources if they are free right now.
+   * @return true on success, grant owns the resources then.
+   * @throws std::invalid_argument if the request can never be granted.
+   */
+  bool tryAcquire(const ResourceRequest &request, ResourceGrant &grant);
+
+  /**
+   * @brief acquire Take resources, waiting for them to free up.
+   * @param pool Pool the awaiting coroutine is resumed on.
+   * @param lane Priority lane to resume on.
+   * @return Awaitable resulting in ResourceGrant. The awaiting coroutine
+   * must not be destroyed while it waits.
+   * @throws std::invalid_argument if the request can never be granted.
+   */
+  template <typename Pool> Awaiter<Pool> acquire(Pool &pool, ResourceRequest request, size_t lane = size_t(-1));
+
+  /**
+   * @brief cpuSlots Return number of CPU slots.
+   */
+  size_t cpuSlots() const noexcept { return m_cpuSlots; }
+
+  /**
+   * @brief inferenceSlots Return total number of inference slots.
+   */
+  size_t inferenceSlots() const noexcept;
+
+  /**
+   * @brief devices Return devices the scheduler was created with.
+   */
+  const std::vector<Device> &devices() const noexcept { return m_devices; }
+
+private:
+  friend class ResourceGrant;
+
+  struct DeviceState {
+    size_t slots;
+    size_t memory;
+  };
+
+  void validate(const ResourceRequest &request) const;
+  bool tryAcquireLocked(const ResourceRequest &request, ResourceGrant &grant);
+  bool fitsLocked(const ResourceRequest &request, size_t device) const;
+  bool enqueue(detail::ResourceWaiter *waiter);
+  void release(const ResourceRequest &taken) noexcept;
+
+  const size_t m_cpuSlots;
+  const std::vector<Device> m_devices;
+
+  std::mutex m_mutex;
+  size_t m_cpuFree;
+  std::vector<DeviceState> m_free;
+  detail::ResourceWaiter *m_head = nullptr;
+  detail::ResourceWaiter *m_tail = nullptr;
+};
+
+/**
+ * @brief The ResourceScheduler::Awaiter class suspends awaiting coroutine
+ * until its request is granted.
+ */
+template <typename Pool> class ResourceScheduler::Awaiter : private detail::ResourceWaiter {
+public:
+  Awaiter(ResourceScheduler &scheduler, Pool &pool, ResourceRequest request, size_t lane)
+      : m_scheduler(scheduler), m_pool(pool), m_lane(lane) {
+    this->request = request;
+    this->grant = &m_grant;
+    this->wake = &Awaiter::resume;
+  }
+
+  bool await_ready() { return m_scheduler.tryAcquire(request, m_grant); }
+
+  bool await_suspend(std::coroutine_handle<> awaiting) {
+    m_awaiting = awaiting;
+    return m_scheduler.enqueue(this);
+  }
+
+  ResourceGrant await_resume() noexcept { return std::move(m_grant); }
+
+private:
+  static void resume(detail::ResourceWaiter *waiter) {
+    Awaiter *self = static_cast<Awaiter *>(waiter);
+    if (!self->m_pool.tryPost(self->m_awaiting, self->m_lane)) {
+      self->m_awaiting.resume();
+    }
+  }
+
+  ResourceScheduler &m_scheduler;
+  Pool &m_pool;
+  size_t m_lane;
+  ResourceGrant m_grant;
+  std::coroutine_handle<> m_awaiting;
+};
+
+/// Implementation
+
+inline ResourceGrant::ResourceGrant(ResourceGrant &&rhs) noexcept
+    : m_scheduler(std::exchange(rhs.m_scheduler, nullptr)), m_taken(rhs.m_taken) {}
+
+inline ResourceGrant &ResourceGrant::operator=(ResourceGrant &&rhs) noexcept {
+  if (this != &rhs) {
+    release();
+    m_scheduler = std::exchange(rhs.m_scheduler, nullptr);
+    m_taken = rhs.m_taken;
+  }
+  return *this;
+}
+
+inline void ResourceGrant::release() noexcept {
+  if (m_scheduler) {
+    std::exchange(m_scheduler, nullptr)->release(m_taken);
+  }
+}
+
+inline ResourceScheduler::ResourceScheduler(size_t cpuSlots, std::vector<Device> devices)
+    : m_cpuSlots(cpuSlots), m_devices(std::move(devices)), m_cpuFree(cpuSlots) {
+  if (m_cpuSlots == 0) {
+    throw std::invalid_argument("ResourceScheduler needs at least one CPU slot");
+  }
+  for (const Device &device : m_devices) {
+    m_free.push_back({device.inferenceSlots, device.memoryBudget});
+  }
+}
+
+inline size_t ResourceScheduler::inferenceSlots() const noexcept {
+  size_t slots = 0;
+  for (const Device &device : m_devices) {
+    slots += device.inferenceSlots;
+  }
+  return slots;
+}
+
+inline void ResourceScheduler::validate(const ResourceRequest &request) const {
+  if (request.cpu > m_cpuSlots) {
+    throw std::invalid_argument("ResourceScheduler request exceeds CPU slots");
+  }
+  if (request.inference == 0 && request.memory == 0) {
+    return;
+  }
+  if (request.device == ResourceRequest::ANY_DEVICE) {
+    for (const Device &device : m_devices) {
+      if (request.inference <= device.inferenceSlots) {
+        return;
+      }
+    }
+    throw std::invalid_argument("ResourceScheduler request exceeds inference slots of every device");
+  }
+  if (request.device >= m_devices.size() || request.inference > m_devices[request.device].inferenceSlots) {
+    throw std::invalid_argument("ResourceScheduler request exceeds inference slots of the device");
+  }
+}
+
+inline bool ResourceScheduler::fitsLocked(const ResourceRequest &request, size_t device) const {
+  const size_t budget = m_devices[device].memoryBudget;
+  const size_t memory = budget == 0 ? 0 : std::min(request.memory, budget);
+  return m_free[device].slots >= request.inference && m_free[device].memory >= memory;
+}
+
+inline bool ResourceScheduler::tryAcquireLocked(const ResourceRequest &request, ResourceGrant &grant) {
+  if (m_cpuFree < request.cpu) {
+    return false;
+  }
+
+  size_t device = ResourceRequest::ANY_DEVICE;
+  if (request.inference != 0 || request.memory != 0) {
+    if (request.device != ResourceRequest::ANY_DEVICE) {
+      device = fitsLocked(request, request.device) ? request.device : device;
+    } else {
+      // The device with the most free inference slots
+      for (size_t i = 0; i < m_devices.size(); ++i) {
+        if (fitsLocked(request, i) &&
+            (device == ResourceRequest::ANY_DEVICE || m_free[i].slots > m_free[device].slots)) {
+          device = i;
+        }
+      }
+    }
+    if (device == ResourceRequest::ANY_DEVICE) {
+      return false;
+    }
+  }
+
+  ResourceRequest taken{.cpu = request.cpu, .inference = 0, .memory = 0, .device = device};
+  if (device != ResourceRequest::ANY_DEVICE) {
+    const size_t budget = m_devices[device].memoryBudget;
+    taken.inference = request.inference;
+    taken.memory = budget == 0 ? 0 : std::min(request.memory, budget);
+    m_free[device].slots -= taken.inference;
+    m_free[device].memory -= taken.memory;
+  }
+  m_cpuFree -= taken.cpu;
+
+  grant.m_scheduler = this;
+  grant.m_taken = taken;
+  return true;
+}
+
+inline bool ResourceScheduler::tryAcquire(const ResourceRequest &request, ResourceGrant &grant) {
+  validate(request);
+  grant.release();
+
+  std::lock_guard lock(m_mutex);
+  // Waiters go first, otherwise a stream of small requests starves them
+  return m_head == nullptr && tryAcquireLocked(request, grant);
+}
+
+template <typename Pool>
+inline ResourceScheduler::Awaiter<Pool> ResourceScheduler::acquire(Pool &pool, ResourceRequest request, size_t lane) {
+  validate(request);
+  return Awaiter<Pool>(*this, pool, request, lane);
+}
+
+inline bool ResourceScheduler::enqueue(detail::ResourceWaiter *waiter) {
+  std::lock_guard lock(m_mutex);
+  // Resources may have been freed since await_ready
+  if (m_head == nullptr && tryAcquireLocked(waiter->request, *waiter->grant)) {
+    return false;
+  }
+
+  waiter->next = nullptr;
+  if (m_tail) {
+    m_tail->next = waiter;
+  } else {
+    m_head = waiter;
+  }
+  m_tail = waiter;
+  return true;
+}
+
+inline void ResourceScheduler::release(const ResourceRequest &taken) noexcept {
+  detail::ResourceWaiter *granted = nullptr;
+  {
+    std::lock_guard lock(m_mutex);
+    m_cpuFree += taken.cpu;
+    if (taken.device != ResourceRequest::ANY_DEVICE) {
+      m_free[taken.device].slots += taken.inference;
+      m_free[taken.device].memory += taken.memory;
+    }
+
+    detail::ResourceWaiter **link = &m_head;
+    detail::ResourceWaiter *prev = nullptr;
+    while (*link) {
+      detail::ResourceWaiter *waiter = *link;
+      if (tryAcquireLocked(waiter->request, *waiter->grant)) {
+        *link = waiter->next;
+        if (m_tail == waiter) {
+          m_tail = prev;
+        }
+        waiter->next = granted;
+        granted = waiter;
+      } else {
+        prev = waiter;
+        link = &waiter->next;
+      }
+    }
+  }
+
+  // Waiters are resumed without the lock, they may release right away
+  while (granted) {
+    detail::ResourceWaiter *waiter = std::exchange(granted, granted->next);
+    waiter->wake(waiter);
+  }
+}
+
+} // namespace tp
+} // namespace limb
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <thread-pool/cancellation-token.hpp>
+#include <thread-pool/fixed-function.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+namespace limb {
+namespace tp {
+
+namespace detail {
+
+/**
+ * @brief The TaskGroupState struct holds tasks of a group which are not
+ * started yet. It is shared with the pool tasks which start them, those may
+ * outlive the group when the waiting thread has run their task itself.
+ */
+struct TaskGroupState {
+  using Task = FixedFunction<void(), 128, HeapFallback>;
+
+  TaskGroupState() : unfinished(0), failed(false) {}
+
+  /**
+   * @brief runOne Take and run one not started task.
+   * @return 'false' if there was none.
+   */
+  bool runOne();
+
+  /**
+   * @brief fail Record failure of a task and cancel the not started ones.
+   * @param failure Exception thrown by the task, null for a failed status.
+   * @return 'true' if it is the first failure.
+   */
+  bool fail(std::exception_ptr failure = nullptr);
+
+  std::mutex mutex;
+  std::condition_variable done;
+  std::deque<Task> pending;
+  /// Tasks not started plus tasks running.
+  size_t unfinished;
+  std::exception_ptr error;
+  bool failed;
+  CancellationSource source;
+};
+
+} // namespace detail
+
+/**
+ * @brief The TaskGroup class runs tasks of a single request in parallel on
+ * the pool and joins them, fork/join style.
+ * Tasks are queued in the group and the pool is only told to run one of
+ * them, so the thread calling wait() takes not started tasks itself instead
+ * of sleeping. A worker waiting for a group never depends on queued pool
+ * tasks, so nested groups cannot deadlock a pool of fixed size.
+ * The first failure, an exception or a status other than 'Status{}', cancels
+ * the group: not started tasks are skipped and running ones may observe
+ * token(). wait() reports the first failure.
+ * The group must be waited for before destruction, the destructor waits
+ * otherwise and suppresses the failure.
+ * @tparam Pool Thread pool, see ThreadPoolImpl.
+ * @tparam Status Type returned by the tasks, 'void' if they return nothing.
+ */
+template <typename Pool, typename Status = void> class TaskGroup {
+public:
+  /**
+   * @brief TaskGroup Constructor.
+   * @param pool Pool the tasks run on.
+   * @param lane Priority lane of the tasks, the lowest priority one by
+   * default.
+   */
+  explicit TaskGroup(Pool &pool, size_t lane = size_t(-1));
+
+  ~TaskGroup();
+
+  /**
+   * @brief run Add task to the group. It may be called from a task of the
+   * group as well.
+   * @param fn Callable as 'fn()' returning Status.
+   * @note If the pool queues are full the task is run by wait().
+   */
+  template <typename Fn> void run(Fn &&fn);
+
+  /**
+   * @brief wait Run not started tasks on the current thread and wait until
+   * the rest are done.
+   * @return First status other than 'Status{}' or 'Status{}'.
+   * @throws First exception thrown by a task.
+   */
+  Status wait();
+
+  /**
+   * @brief cancel Skip tasks which are not started yet.
+   */
+  void cancel() noexcept { m_state->source.cancel(); }
+
+  /**
+   * @brief token Return token tripped when the group fails or is cancelled,
+   * long tasks check it to stop early.
+   */
+  CancellationToken token() const { return m_state->source.token(); }
+
+private:
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  struct NoStatus {};
+  using StatusStorage = std::conditional_t<std::is_void_v<Status>, NoStatus, Status>;
+
+  void join();
+
+  Pool &m_pool;
+  size_t m_lane;
+  std::shared_ptr<detail::TaskGroupState> m_state;
+  /// First failed status, written by the task which failed first.
+  StatusStorage m_status;
+};
+
+/// Implementation
+
+inline bool detail::TaskGroupState::runOne() {
+  Task task;
+  {
+    std::lock_guard lock(mutex);
+    if (pending.empty()) {
+      return false;
+    }
+    task = std::move(pending.front());
+    pending.pop_front();
+  }
+
+  if (!source.isCancelled()) {
+    try {
+      task();
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  }
+  // Captures are released before the waiter may return
+  task = Task();
+
+  std::lock_guard lock(mutex);
+  if (--unfinished == 0) {
+    done.notify_all();
+  }
+  return true;
+}
+
+inline bool detail::TaskGroupState::fail(std::exception_ptr failure) {
+  {
+    std::lock_guard lock(mutex);
+    if (failed) {
+      return false;
+    }
+    failed = true;
+    error = std::move(failure);
+  }
+  source.cancel();
+  return true;
+}
+
+template <typename Pool, typename Status>
+inline TaskGroup<Pool, Status>::TaskGroup(Pool &pool, size_t lane)
+    : m_pool(pool), m_lane(lane), m_state(std::make_shared<detail::TaskGroupState>()), m_status() {}
+
+template <typename Pool, typename Status> inline TaskGroup<Pool, Status>::~TaskGroup() { join(); }
+
+template <typename Pool, typename Status>
+template <typename Fn>
+inline void TaskGroup<Pool, Status>::run(Fn &&fn) {
+  {
+    std::lock_guard lock(m_state->mutex);
+    m_state->pending.emplace_back([this, fn = std::forward<Fn>(fn)]() mutable {
+      if constexpr (std::is_void_v<Status>) {
+        fn();
+      } else {
+        Status status = fn();
+        if (status != Status{} && m_state->fail()) {
+          m_status = std::move(status);
+        }
+      }
+    });
+    ++m_state->unfinished;
+  }
+
+  // The worker picks whichever task is queued first, wait() takes the rest
+  m_pool.tryPost([state = m_state]() { state->runOne(); }, m_lane);
+}
+
+template <typename Pool, typename Status> inline void TaskGroup<Pool, Status>::join() {
+  while (m_state->runOne()) {
+  }
+
+  auto finished = [this]() { return m_state->unfinished == 0; };
+  {
+    std::lock_guard lock(m_state->mutex);
+    if (finished()) {
+      return;
+    }
+  }
+
+  // The rest are running on other workers, let the pool use this one meanwhile
+  m_pool.blocking([this, &finished]() {
+    std::unique_lock lock(m_state->mutex);
+    m_state->done.wait(lock, finished);
+  });
+}
+
+template <typename Pool, typename Status> inline Status TaskGroup<Pool, Status>::wait() {
+  join();
+
+  std::lock_guard lock(m_state->mutex);
+  if (m_state->error) {
+    std::rethrow_exception(m_state->error);
+  }
+  if constexpr (!std::is_void_v<Status>) {
+    return m_status;
+  }
+}
+
+} // namespace tp
+} // namespace limb
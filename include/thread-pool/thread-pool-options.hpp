@@ -1,7 +1,11 @@
 #pragma once
 
+#include <thread-pool/cpu-topology.hpp>
+
 #include <algorithm>
+#include <chrono>
 #include <thread>
+#include <vector>
 namespace limb {
 namespace tp {
 
@@ -22,39 +26,262 @@ public:
    */
   void setThreadCount(size_t count);
 
+  /**
+   * @brief setThreadBounds Make the pool elastic.
+   * @param min Number of workers kept running while the pool is idle.
+   * @param max Number of workers the pool may grow to. Thread count set
+   * with setThreadCount is the initial one.
+   */
+  void setThreadBounds(size_t min, size_t max);
+
+  /**
+   * @brief setGrowThreshold Set queue wait time after which elastic pool
+   * starts one more worker.
+   */
+  void setGrowThreshold(std::chrono::nanoseconds threshold);
+
+  /**
+   * @brief setKeepAlive Set time after which parked worker of elastic pool
+   * is retired.
+   */
+  void setKeepAlive(std::chrono::nanoseconds keep_alive);
+
+  /**
+   * @brief setMaxCompensationThreads Set number of workers the pool may
+   * start above the maximal thread count while workers are blocked in
+   * ThreadPool::blocking. Zero, the default, disables compensation.
+   */
+  void setMaxCompensationThreads(size_t count);
+
+  /**
+   * @brief setTimerResolution Set granularity of delayed tasks, see
+   * ThreadPool::postAfter. Deadlines are rounded up to it.
+   */
+  void setTimerResolution(std::chrono::nanoseconds resolution);
+
   /**
    * @brief setQueueSize Set single worker queue size.
    * @param count Maximum length of queue of single worker.
    */
   void setQueueSize(size_t size);
 
+  /**
+   * @brief setWatermarks Set queue occupancy thresholds for the pool's
+   * watermark handler.
+   * @param low Occupancy at which saturated pool is reported as drained.
+   * @param high Occupancy at which pool is reported as saturated. Zero
+   * disables watermark reporting.
+   */
+  void setWatermarks(size_t low, size_t high);
+
+  /**
+   * @brief setLaneCount Set number of priority lanes.
+   * @param count Number of lanes. Lane 0 has the highest priority, the last
+   * lane has the lowest one.
+   */
+  void setLaneCount(size_t count);
+
+  /**
+   * @brief setAgingInterval Set anti-starvation interval.
+   * @param interval Every 'interval'-th task taken by a worker is searched
+   * starting from a lower priority lane.
+   */
+  void setAgingInterval(size_t interval);
+
+  /**
+   * @brief setFutureSlabSize Set number of preallocated future states.
+   * @param count Number of results of submitted tasks which may be pending
+   * at the same time without heap allocation.
+   */
+  void setFutureSlabSize(size_t count);
+
+  /**
+   * @brief setCpuSet Set CPUs workers may run on.
+   * @param cpus CPU numbers, empty set means all CPUs.
+   */
+  void setCpuSet(std::vector<size_t> cpus);
+
+  /**
+   * @brief setPlacement Set how workers are pinned to CPUs of the CPU set.
+   * @param placement Placement strategy, see WorkerPlacement.
+   */
+  void setPlacement(WorkerPlacement placement);
+
   /**
    * @brief threadCount Return thread count.
    */
   size_t threadCount() const;
 
+  /**
+   * @brief minThreadCount Return minimal number of workers.
+   */
+  size_t minThreadCount() const;
+
+  /**
+   * @brief maxThreadCount Return maximal number of workers.
+   */
+  size_t maxThreadCount() const;
+
+  /**
+   * @brief growThreshold Return queue wait time which makes elastic pool grow.
+   */
+  std::chrono::nanoseconds growThreshold() const;
+
+  /**
+   * @brief keepAlive Return time after which parked worker is retired.
+   */
+  std::chrono::nanoseconds keepAlive() const;
+
+  /**
+   * @brief maxCompensationThreads Return number of workers which may be
+   * started to compensate for blocked ones.
+   */
+  size_t maxCompensationThreads() const;
+
+  /**
+   * @brief timerResolution Return granularity of delayed tasks.
+   */
+  std::chrono::nanoseconds timerResolution() const;
+
   /**
    * @brief queueSize Return single worker queue size.
    */
   size_t queueSize() const;
 
+  /**
+   * @brief lowWatermark Return occupancy at which pool is reported as drained.
+   */
+  size_t lowWatermark() const;
+
+  /**
+   * @brief highWatermark Return occupancy at which pool is reported as
+   * saturated.
+   */
+  size_t highWatermark() const;
+
+  /**
+   * @brief laneCount Return number of priority lanes.
+   */
+  size_t laneCount() const;
+
+  /**
+   * @brief agingInterval Return anti-starvation interval.
+   */
+  size_t agingInterval() const;
+
+  /**
+   * @brief futureSlabSize Return number of preallocated future states.
+   */
+  size_t futureSlabSize() const;
+
+  /**
+   * @brief cpuSet Return CPUs workers may run on.
+   */
+  const std::vector<size_t> &cpuSet() const;
+
+  /**
+   * @brief placement Return worker placement strategy.
+   */
+  WorkerPlacement placement() const;
+
 private:
   size_t m_thread_count;
+  size_t m_min_thread_count;
+  size_t m_max_thread_count;
+  std::chrono::nanoseconds m_grow_threshold;
+  std::chrono::nanoseconds m_keep_alive;
+  size_t m_max_compensation;
+  std::chrono::nanoseconds m_timer_resolution;
   size_t m_queue_size;
+  size_t m_low_watermark;
+  size_t m_high_watermark;
+  size_t m_lane_count;
+  size_t m_aging_interval;
+  size_t m_future_slab_size;
+  std::vector<size_t> m_cpu_set;
+  WorkerPlacement m_placement;
 };
 
 /// Implementation
 
 inline ThreadPoolOptions::ThreadPoolOptions()
-    : m_thread_count(std::max<size_t>(1u, std::thread::hardware_concurrency())), m_queue_size(1024u) {}
+    : m_thread_count(std::max<size_t>(1u, std::thread::hardware_concurrency())), m_min_thread_count(0u),
+      m_max_thread_count(0u), m_grow_threshold(std::chrono::milliseconds(50)), m_keep_alive(std::chrono::seconds(10)),
+      m_max_compensation(0u), m_timer_resolution(std::chrono::milliseconds(1)), m_queue_size(1024u),
+      m_low_watermark(0u), m_high_watermark(0u), m_lane_count(1u), m_aging_interval(8u), m_future_slab_size(1024u),
+      m_placement(WorkerPlacement::kNone) {}
 
 inline void ThreadPoolOptions::setThreadCount(size_t count) { m_thread_count = std::max<size_t>(1u, count); }
 
+inline void ThreadPoolOptions::setThreadBounds(size_t min, size_t max) {
+  m_min_thread_count = std::max<size_t>(1u, min);
+  m_max_thread_count = std::max(m_min_thread_count, max);
+}
+
+inline void ThreadPoolOptions::setGrowThreshold(std::chrono::nanoseconds threshold) {
+  m_grow_threshold = std::max(threshold, std::chrono::nanoseconds(1));
+}
+
+inline void ThreadPoolOptions::setKeepAlive(std::chrono::nanoseconds keep_alive) {
+  m_keep_alive = std::max(keep_alive, std::chrono::nanoseconds(1));
+}
+
+inline void ThreadPoolOptions::setMaxCompensationThreads(size_t count) { m_max_compensation = count; }
+
+inline void ThreadPoolOptions::setTimerResolution(std::chrono::nanoseconds resolution) {
+  m_timer_resolution = std::max(resolution, std::chrono::nanoseconds(1));
+}
+
 inline void ThreadPoolOptions::setQueueSize(size_t size) { m_queue_size = std::max<size_t>(1u, size); }
 
+inline void ThreadPoolOptions::setWatermarks(size_t low, size_t high) {
+  m_high_watermark = high;
+  m_low_watermark = std::min(low, high);
+}
+
+inline void ThreadPoolOptions::setLaneCount(size_t count) { m_lane_count = std::max<size_t>(1u, count); }
+
+inline void ThreadPoolOptions::setAgingInterval(size_t interval) { m_aging_interval = std::max<size_t>(2u, interval); }
+
+inline void ThreadPoolOptions::setFutureSlabSize(size_t count) { m_future_slab_size = std::max<size_t>(2u, count); }
+
+inline void ThreadPoolOptions::setCpuSet(std::vector<size_t> cpus) { m_cpu_set = std::move(cpus); }
+
+inline void ThreadPoolOptions::setPlacement(WorkerPlacement placement) { m_placement = placement; }
+
 inline size_t ThreadPoolOptions::threadCount() const { return m_thread_count; }
 
+inline size_t ThreadPoolOptions::minThreadCount() const {
+  return m_max_thread_count ? m_min_thread_count : m_thread_count;
+}
+
+inline size_t ThreadPoolOptions::maxThreadCount() const {
+  return m_max_thread_count ? m_max_thread_count : m_thread_count;
+}
+
+inline std::chrono::nanoseconds ThreadPoolOptions::growThreshold() const { return m_grow_threshold; }
+
+inline std::chrono::nanoseconds ThreadPoolOptions::keepAlive() const { return m_keep_alive; }
+
+inline size_t ThreadPoolOptions::maxCompensationThreads() const { return m_max_compensation; }
+
+inline std::chrono::nanoseconds ThreadPoolOptions::timerResolution() const { return m_timer_resolution; }
+
 inline size_t ThreadPoolOptions::queueSize() const { return m_queue_size; }
 
+inline size_t ThreadPoolOptions::lowWatermark() const { return m_low_watermark; }
+
+inline size_t ThreadPoolOptions::highWatermark() const { return m_high_watermark; }
+
+inline size_t ThreadPoolOptions::laneCount() const { return m_lane_count; }
+
+inline size_t ThreadPoolOptions::agingInterval() const { return m_aging_interval; }
+
+inline size_t ThreadPoolOptions::futureSlabSize() const { return m_future_slab_size; }
+
+inline const std::vector<size_t> &ThreadPoolOptions::cpuSet() const { return m_cpu_set; }
+
+inline WorkerPlacement ThreadPoolOptions::placement() const { return m_placement; }
+
 } // namespace tp
 } // namespace limb
\ No newline at end of file
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+namespace limb {
+namespace tp {
+
+namespace detail {
+/**
+ * @brief monotonicNs Return monotonic clock value in nanoseconds.
+ */
+inline uint64_t monotonicNs() {
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+} // namespace detail
+
+/**
+ * @brief The HistogramSnapshot struct is a point-in-time copy of
+ * LatencyHistogram.
+ */
+struct HistogramSnapshot {
+  /**
+   * @brief percentile Return upper bound of the bucket holding given
+   * percentile, in nanoseconds.
+   * @param p Percentile in [0, 100].
+   */
+  uint64_t percentile(double p) const;
+
+  /**
+   * @brief mean Return mean value in nanoseconds.
+   */
+  uint64_t mean() const;
+
+  /**
+   * @brief merge Add counts of other snapshot to this one.
+   */
+  void merge(const HistogramSnapshot &other);
+
+  std::vector<uint64_t> buckets;
+  uint64_t count = 0;
+  uint64_t sum = 0;
+};
+
+/**
+ * @brief The LatencyHistogram class implements HDR-style histogram of
+ * nanosecond durations.
+ * Every power of 2 range is split into SUB_BUCKETS linear buckets, so the
+ * relative error is below 1/SUB_BUCKETS over the whole range.
+ * It has a single writer and any number of readers: record() is a couple of
+ * relaxed stores, snapshot() may run concurrently with it.
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned SUB_BITS = 3;
+  static constexpr unsigned SUB_BUCKETS = 1u << SUB_BITS;
+  /// Values above 2^MAX_BIT ns (about 2.4 hours) go to the last bucket.
+  static constexpr unsigned MAX_BIT = 43;
+  static constexpr size_t BUCKET_COUNT = (MAX_BIT - SUB_BITS + 2) * SUB_BUCKETS;
+
+  LatencyHistogram();
+
+  /**
+   * @brief record Add value to the histogram. Owner thread only.
+   * @param ns Duration in nanoseconds.
+   */
+  void record(uint64_t ns);
+
+  /**
+   * @brief snapshot Copy current counts. Any thread.
+   */
+  HistogramSnapshot snapshot() const;
+
+  /**
+   * @brief bucketIndex Return index of the bucket holding value.
+   */
+  static size_t bucketIndex(uint64_t ns);
+
+  /**
+   * @brief bucketUpperBound Return the largest value held by bucket.
+   */
+  static uint64_t bucketUpperBound(size_t index);
+
+private:
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+  std::atomic<uint64_t> m_sum;
+};
+
+/**
+ * @brief The WorkerCounters struct holds counters of a single worker.
+ * It is cacheline aligned so that workers don't share lines, and counters
+ * written by posting threads are kept apart from the ones written by the
+ * worker itself.
+ */
+struct alignas(64) WorkerCounters {
+  WorkerCounters() : posted(0), rejected(0), stolen(0), executed(0) {}
+
+  /**
+   * @brief bump Increment counter written by the owner thread only.
+   */
+  static void bump(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /// Written by posting threads.
+  std::atomic<uint64_t> posted;
+  std::atomic<uint64_t> rejected;
+
+  /// Written by the worker thread.
+  alignas(64) std::atomic<uint64_t> stolen;
+  std::atomic<uint64_t> executed;
+  LatencyHistogram wait_time;
+  LatencyHistogram run_time;
+};
+
+/**
+ * @brief The WorkerStats struct is a point-in-time copy of worker counters.
+ */
+struct WorkerStats {
+  /// Tasks queued to the worker.
+  uint64_t posted = 0;
+  /// Tasks refused because all queues were full.
+  uint64_t rejected = 0;
+  /// Tasks the worker took from its siblings.
+  uint64_t stolen = 0;
+  /// Tasks the worker ran.
+  uint64_t executed = 0;
+  /// Tasks waiting in the worker queues.
+  size_t occupancy = 0;
+  /// Worker has running thread.
+  bool active = false;
+  /// Time from post to start of execution.
+  HistogramSnapshot wait_time;
+  /// Execution time.
+  HistogramSnapshot run_time;
+};
+
+/**
+ * @brief The ThreadPoolStats struct is a snapshot of thread pool counters.
+ */
+struct ThreadPoolStats {
+  /**
+   * @brief total Return counters summed over all workers.
+   */
+  WorkerStats total() const;
+
+  std::vector<WorkerStats> workers;
+  /// Number of running workers.
+  size_t threads = 0;
+  /// Number of workers started and retired by the elastic pool supervisor.
+  uint64_t grown = 0;
+  uint64_t shrunk = 0;
+  /// Number of workers started to compensate for workers blocked in
+  /// ThreadPool::blocking.
+  uint64_t compensated = 0;
+};
+
+/// Implementation
+
+inline LatencyHistogram::LatencyHistogram() : m_sum(0) {
+  for (auto &bucket : m_buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+inline size_t LatencyHistogram::bucketIndex(uint64_t ns) {
+  if (ns < SUB_BUCKETS) {
+    return size_t(ns);
+  }
+
+  const unsigned msb = std::min<unsigned>(unsigned(std::bit_width(ns)) - 1, MAX_BIT);
+  if (msb == MAX_BIT && (ns >> MAX_BIT) > 1) {
+    return BUCKET_COUNT - 1;
+  }
+  const size_t sub = size_t(ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+inline uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  if (index >= BUCKET_COUNT - 1) {
+    return UINT64_MAX;
+  }
+
+  const unsigned msb = unsigned(index / SUB_BUCKETS) + SUB_BITS - 1;
+  const uint64_t sub = index % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << (msb - SUB_BITS)) - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t ns) {
+  auto &bucket = m_buckets[bucketIndex(ns)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  m_sum.store(m_sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+inline HistogramSnapshot LatencyHistogram::snapshot() const {
+  HistogramSnapshot result;
+  result.buckets.resize(BUCKET_COUNT);
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    result.count += result.buckets[i];
+  }
+  result.sum = m_sum.load(std::memory_order_relaxed);
+  return result;
+}
+
+inline uint64_t HistogramSnapshot::percentile(double p) const {
+  if (count == 0) {
+    return 0;
+  }
+
+  const uint64_t rank = std::max<uint64_t>(1u, uint64_t(double(count) * std::clamp(p, 0.0, 100.0) / 100.0 + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return LatencyHistogram::bucketUpperBound(i);
+    }
+  }
+  return LatencyHistogram::bucketUpperBound(buckets.size() - 1);
+}
+
+inline uint64_t HistogramSnapshot::mean() const { return count ? sum / count : 0; }
+
+inline void HistogramSnapshot::merge(const HistogramSnapshot &other) {
+  buckets.resize(std::max(buckets.size(), other.buckets.size()));
+  for (size_t i = 0; i < other.buckets.size(); ++i) {
+    buckets[i] += other.buckets[i];
+  }
+  count += other.count;
+  sum += other.sum;
+}
+
+inline WorkerStats ThreadPoolStats::total() const {
+  WorkerStats result;
+  for (const auto &worker : workers) {
+    result.posted += worker.posted;
+    result.rejected += worker.rejected;
+    result.stolen += worker.stolen;
+    result.executed += worker.executed;
+    result.occupancy += worker.occupancy;
+    result.active = result.active || worker.active;
+    result.wait_time.merge(worker.wait_time);
+    result.run_time.merge(worker.run_time);
+  }
+  return result;
+}
+
+} // namespace tp
+} // namespace limb
@@ -1,31 +1,66 @@
 #pragma once
 
+#include <thread-pool/coroutine.hpp>
+#include <thread-pool/cpu-topology.hpp>
+#include <thread-pool/event-count.hpp>
 #include <thread-pool/fixed-function.hpp>
+#include <thread-pool/future.hpp>
 #include <thread-pool/limb-queue.hpp>
 #include <thread-pool/thread-pool-options.hpp>
+#include <thread-pool/thread-pool-stats.hpp>
+#include <thread-pool/timer-wheel.hpp>
+#include <thread-pool/unbounded-queue.hpp>
 #include <thread-pool/worker.hpp>
 
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
+#include <iterator>
 #include <memory>
+#include <ranges>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
 namespace limb {
 namespace tp {
 
 template <typename Task, template <typename> class Queue> class ThreadPoolImpl;
-using ThreadPool = ThreadPoolImpl<FixedFunction<void(), 128>, MPMCBoundedQueue>;
+using BoundedThreadPool = ThreadPoolImpl<FixedFunction<void(), 128>, MPMCBoundedQueue>;
+using UnboundedThreadPool = ThreadPoolImpl<FixedFunction<void(), 128>, MPMCUnboundedQueue>;
+
+// Deployments that prefer buffering over rejecting tasks build with LIMB_TP_UNBOUNDED_QUEUE
+#if defined(LIMB_TP_UNBOUNDED_QUEUE)
+using ThreadPool = UnboundedThreadPool;
+#else
+using ThreadPool = BoundedThreadPool;
+#endif
 
 /**
  * @brief The ThreadPool class implements thread pool pattern.
  * It is highly scalable and fast.
  * It is header only.
  * It implements both work-stealing and work-distribution balancing
- * startegies.
+ * startegies: tasks posted from a worker stay in its local deque, tasks
+ * posted from foreign threads are distributed between workers in round-robin
+ * order and idle workers steal from random siblings.
+ * Tasks may be posted to one of several priority lanes, workers drain higher
+ * priority lanes first but periodically serve lower ones to avoid starvation.
+ * Pool may be elastic: it grows when tasks wait in the queues for too long and
+ * shrinks when workers stay idle, see ThreadPoolOptions::setThreadBounds.
+ * Workers blocked in I/O may be compensated by extra workers, see blocking().
+ * Tasks may be delayed, they wait in a hierarchical timer wheel served by a
+ * single timer thread, see postAfter().
  * It implements cooperative scheduling strategy for tasks.
  */
 template <typename Task, template <typename> class Queue> class ThreadPoolImpl {
 public:
+  using WatermarkHandler = typename PoolState<Task, Queue>::WatermarkHandler;
+  using ResizeHandler = typename PoolState<Task, Queue>::ResizeHandler;
+
+  /// Lane used when none is specified: the lowest priority one.
+  static constexpr size_t DEFAULT_LANE = size_t(-1);
+
   /**
    * @brief ThreadPool Construct and start new thread pool.
    * @param options Creation options.
@@ -51,54 +86,268 @@ public:
    * @brief post Try post job to thread pool.
    * @param handler Handler to be called from thread pool worker. It has
    * to be callable as 'handler()'.
+   * @param lane Priority lane, 0 is the highest priority.
    * @return 'true' on success, false otherwise.
    * @note All exceptions thrown by handler will be suppressed.
    */
-  template <typename Handler> bool tryPost(Handler &&handler);
+  template <typename Handler> bool tryPost(Handler &&handler, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief postFor Post job to thread pool, waiting for free space in the
+   * queues if they are full.
+   * @param handler Handler to be called from thread pool worker. It has
+   * to be callable as 'handler()'.
+   * @param timeout Maximum time to wait for free space.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @return 'true' on success, false if timeout expired.
+   * @note All exceptions thrown by handler will be suppressed.
+   */
+  template <typename Handler, typename Rep, typename Period>
+  bool postFor(Handler &&handler, const std::chrono::duration<Rep, Period> &timeout, size_t lane = DEFAULT_LANE);
 
   /**
    * @brief post Post job to thread pool.
    * @param handler Handler to be called from thread pool worker. It has
    * to be callable as 'handler()'.
+   * @param lane Priority lane, 0 is the highest priority.
    * @throw std::overflow_error if worker's queue is full.
    * @note All exceptions thrown by handler will be suppressed.
    */
-  template <typename Handler> void post(Handler &&handler);
+  template <typename Handler> void post(Handler &&handler, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief postBulk Try post several jobs to thread pool at once. Queue
+   * cells for the whole batch are reserved with a single CAS and up to
+   * 'number of posted jobs' parked workers are woken together.
+   * @param handlers Sized range of handlers, each callable as 'handler()'.
+   * Posted handlers are moved from.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @return Number of posted handlers, the first ones of the range.
+   * @note All exceptions thrown by handlers will be suppressed.
+   */
+  template <typename Range> size_t postBulk(Range &&handlers, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief postAfter Post job to thread pool once delay expires.
+   * @param delay Time to wait, rounded up to ThreadPoolOptions::timerResolution.
+   * @param handler Handler to be called from thread pool worker. It has
+   * to be callable as 'handler()'.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @return Handle which cancels the job. It may be dropped.
+   * @note If the queues are full when the delay expires, posting is retried
+   * on every timer tick. All exceptions thrown by handler will be suppressed.
+   */
+  template <typename Handler, typename Rep, typename Period>
+  TimerHandle postAfter(const std::chrono::duration<Rep, Period> &delay, Handler &&handler, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief postAt Post job to thread pool at given time, see postAfter.
+   * @param deadline Time point to post at, a passed one posts on the next
+   * timer tick.
+   */
+  template <typename Handler>
+  TimerHandle postAt(std::chrono::steady_clock::time_point deadline, Handler &&handler, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief submit Post job to thread pool and return future for its result.
+   * @param handler Handler to be called from thread pool worker. It has
+   * to be callable as 'handler()'.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @return Future for value returned or exception thrown by handler.
+   * @throw std::runtime_error if worker's queue is full.
+   * @note Result state is taken from the pool's preallocated slab, so no heap
+   * allocation is made until more than ThreadPoolOptions::futureSlabSize()
+   * results are pending.
+   */
+  template <typename Handler>
+  auto submit(Handler &&handler, size_t lane = DEFAULT_LANE) -> Future<std::invoke_result_t<std::decay_t<Handler> &>>;
+
+  /**
+   * @brief schedule Return awaitable which resumes awaiting coroutine on a
+   * pool worker, 'co_await pool.schedule()'.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @note If the queues are full the coroutine continues on the current
+   * thread.
+   */
+  ScheduleAwaiter<ThreadPoolImpl> schedule(size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief scheduleAfter Return awaitable which resumes awaiting coroutine
+   * on a pool worker once delay expires, 'co_await pool.scheduleAfter(1ms)'.
+   * @param delay Time to wait, rounded up to ThreadPoolOptions::timerResolution.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @note Unlike schedule() the coroutine never continues on the current
+   * thread, full queues are retried on every timer tick.
+   */
+  DelayAwaiter<ThreadPoolImpl> scheduleAfter(std::chrono::steady_clock::duration delay, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief spawn Start detached coroutine on a pool worker.
+   * @param task Coroutine to be started, it destroys itself on completion.
+   * @param lane Priority lane, 0 is the highest priority.
+   * @throw std::runtime_error if worker's queue is full, the coroutine is
+   * destroyed then.
+   * @note All exceptions thrown by the coroutine will be suppressed.
+   */
+  void spawn(CoTask<void> task, size_t lane = DEFAULT_LANE);
+
+  /**
+   * @brief blocking Run blocking call (I/O, waiting for a lock or a device)
+   * on the current worker, letting the pool keep cores busy meanwhile: a
+   * parked sibling is woken up to take over the queued tasks or, if there is
+   * none, a compensating worker is started. Compensating workers are capped
+   * by ThreadPoolOptions::setMaxCompensationThreads and retired after
+   * keep-alive time of idling.
+   * @param fn Blocking call, callable as 'fn()'.
+   * @return Result of fn. Called from a foreign thread it just calls fn.
+   */
+  template <typename Fn> auto blocking(Fn &&fn) -> std::invoke_result_t<Fn &>;
+
+  /**
+   * @brief size Approximate number of tasks waiting in the queues.
+   */
+  size_t size() const;
+
+  /**
+   * @brief capacity Number of tasks that can be queued from foreign threads,
+   * the largest size_t value for unbounded queues.
+   */
+  size_t capacity() const;
+
+  /**
+   * @brief laneCount Return number of priority lanes.
+   */
+  size_t laneCount() const;
+
+  /**
+   * @brief stats Return snapshot of the workers' counters. Workers are not
+   * stopped, so counters of different workers are read at slightly different
+   * moments.
+   */
+  ThreadPoolStats stats() const;
+
+  /**
+   * @brief setWatermarkHandler Set handler called with 'true' when queue
+   * occupancy reaches high watermark and with 'false' when it falls back to
+   * low watermark. See ThreadPoolOptions::setWatermarks.
+   * @param handler Handler to be called. It is called from posting thread or
+   * from worker thread and must not post to this pool.
+   * @note Should be set before jobs are posted.
+   */
+  void setWatermarkHandler(WatermarkHandler handler);
+
+  /**
+   * @brief threadCount Return number of running workers.
+   */
+  size_t threadCount() const;
+
+  /**
+   * @brief setResizeHandler Set handler called with old and new number of
+   * running workers whenever elastic pool grows or shrinks. See
+   * ThreadPoolOptions::setThreadBounds.
+   * @param handler Handler to be called. It is called from the supervisor
+   * thread.
+   */
+  void setResizeHandler(ResizeHandler handler);
 
 private:
+  /**
+   * @brief getWorker Return worker that owns current thread or next worker
+   * in round-robin order if called from a foreign thread.
+   */
   Worker<Task, Queue> &getWorker();
 
-  std::vector<std::unique_ptr<Worker<Task, Queue>>> m_workers;
-
-  std::shared_ptr<Queue<Task>> ring_buffer;
-  std::condition_variable handler_cv;
+  std::unique_ptr<PoolState<Task, Queue>> m_state;
 };
 
 /// Implementation
 
 template <typename Task, template <typename> class Queue>
 inline ThreadPoolImpl<Task, Queue>::ThreadPoolImpl(const ThreadPoolOptions &options)
-    : m_workers(options.threadCount()), ring_buffer(std::make_shared<Queue<Task>>(options.queueSize())) {
-  for (auto &worker_ptr : m_workers) {
-    worker_ptr.reset(new Worker<Task, Queue>(ring_buffer));
+    : m_state(std::make_unique<PoolState<Task, Queue>>()) {
+  m_state->lane_count = options.laneCount();
+  m_state->aging_interval = options.agingInterval();
+  m_state->low_watermark = options.lowWatermark();
+  m_state->high_watermark = options.highWatermark();
+  m_state->future_slab = FutureSlab::create(options.futureSlabSize());
+
+  m_state->min_threads = options.minThreadCount();
+  m_state->max_threads = options.maxThreadCount();
+  m_state->grow_threshold_ns = m_state->isElastic() ? uint64_t(options.growThreshold().count()) : 0u;
+  m_state->keep_alive_ns = uint64_t(options.keepAlive().count());
+  m_state->max_compensation = options.maxCompensationThreads();
+  m_state->timer_resolution_ns = uint64_t(options.timerResolution().count());
+
+  // Slots for all threads the pool may grow to, IDs of workers are stable
+  auto &workers = m_state->workers;
+  workers.resize(m_state->max_threads + m_state->max_compensation);
+  for (auto &worker_ptr : workers) {
+    worker_ptr.reset(new Worker<Task, Queue>(options.queueSize(), options.laneCount()));
+  }
+
+  m_state->placement = CpuTopology::detect().place(workers.size(), options.placement(), options.cpuSet());
+
+  const size_t initial = std::clamp(options.threadCount(), m_state->min_threads, m_state->max_threads);
+  size_t started = 0;
+  try {
+    for (; started < initial; ++started) {
+      workers[started]->start(started, *m_state, m_state->placement[started]);
+    }
+  } catch (...) {
+    for (size_t i = 0; i < started; ++i) {
+      workers[i]->stop();
+    }
+    m_state->started.store(true, std::memory_order_release);
+    m_state->started.notify_all();
+    for (size_t i = 0; i < started; ++i) {
+      workers[i]->join();
+    }
+    throw;
   }
 
-  for (size_t i = 0; i < m_workers.size(); ++i) {
-    m_workers[i]->start(i, handler_cv);
+  m_state->active_count.store(initial, std::memory_order_relaxed);
+  m_state->started.store(true, std::memory_order_release);
+  m_state->started.notify_all();
+
+  if (m_state->needsSupervisor()) {
+    m_state->supervisor = std::thread(&PoolState<Task, Queue>::supervise, m_state.get());
   }
 }
 
 template <typename Task, template <typename> class Queue>
 inline ThreadPoolImpl<Task, Queue>::ThreadPoolImpl(ThreadPoolImpl<Task, Queue> &&rhs) noexcept {
-  *this = rhs;
+  *this = std::move(rhs);
 }
 
 template <typename Task, template <typename> class Queue> inline ThreadPoolImpl<Task, Queue>::~ThreadPoolImpl() {
-  for (auto &worker_ptr : m_workers) {
+  if (!m_state) {
+    return;
+  }
+
+  // Pending delayed tasks are dropped
+  {
+    std::lock_guard lock(m_state->timer_mutex);
+    m_state->timer_stop = true;
+  }
+  m_state->timer_cv.notify_one();
+  if (m_state->timer.joinable()) {
+    m_state->timer.join();
+  }
+
+  if (m_state->supervisor.joinable()) {
+    {
+      std::lock_guard lock(m_state->supervisor_mutex);
+      m_state->supervisor_stop = true;
+    }
+    m_state->supervisor_cv.notify_one();
+    m_state->supervisor.join();
+  }
+
+  for (auto &worker_ptr : m_state->workers) {
     worker_ptr->stop();
   }
-  handler_cv.notify_all();
-  for (auto &worker_ptr : m_workers) {
+  m_state->idle.notifyAll();
+  for (auto &worker_ptr : m_state->workers) {
     worker_ptr->join();
   }
 }
@@ -106,38 +355,239 @@ template <typename Task, template <typename> class Queue> inline ThreadPoolImpl<
 template <typename Task, template <typename> class Queue>
 inline ThreadPoolImpl<Task, Queue> &ThreadPoolImpl<Task, Queue>::operator=(ThreadPoolImpl<Task, Queue> &&rhs) noexcept {
   if (this != &rhs) {
-    m_workers = std::move(rhs.m_workers);
+    // Previous state is shut down by rhs destructor
+    std::swap(m_state, rhs.m_state);
   }
   return *this;
 }
 
 template <typename Task, template <typename> class Queue>
 template <typename Handler>
-inline bool ThreadPoolImpl<Task, Queue>::tryPost(Handler &&handler) {
-  bool ret = ring_buffer->push(std::forward<Handler>(handler));
-  if (ret) {
-    handler_cv.notify_one();
+inline bool ThreadPoolImpl<Task, Queue>::tryPost(Handler &&handler, size_t lane) {
+  const size_t count = m_state->active_count.load(std::memory_order_relaxed);
+  Worker<Task, Queue> *const first = &getWorker();
+  Worker<Task, Queue> *worker = first;
+
+  lane = std::min(lane, m_state->lane_count - 1);
+
+  // Fall back to siblings when the chosen worker's queue is full
+  for (size_t i = 0; i < std::max<size_t>(count, 1u); ++i) {
+    if (worker->post(std::forward<Handler>(handler), lane)) {
+      m_state->idle.notify();
+      m_state->checkHighWatermark(1);
+      return true;
+    }
+    worker = &m_state->nextWorker();
+  }
+  first->counters().rejected.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Handler, typename Rep, typename Period>
+inline bool ThreadPoolImpl<Task, Queue>::postFor(Handler &&handler, const std::chrono::duration<Rep, Period> &timeout,
+                                                 size_t lane) {
+  using clock = std::chrono::steady_clock;
+
+  if (tryPost(std::forward<Handler>(handler), lane)) {
+    return true;
+  }
+
+  const auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(timeout);
+  auto backoff = std::chrono::microseconds(50);
+  constexpr auto max_backoff = std::chrono::microseconds(1000);
+
+  for (;;) {
+    const auto now = clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::min<clock::duration>(backoff, deadline - now));
+    backoff = std::min(backoff * 2, max_backoff);
+
+    if (tryPost(std::forward<Handler>(handler), lane)) {
+      return true;
+    }
   }
-  return ret;
 }
 
 template <typename Task, template <typename> class Queue>
 template <typename Handler>
-inline void ThreadPoolImpl<Task, Queue>::post(Handler &&handler) {
-  const auto ok = tryPost(std::forward<Handler>(handler));
+inline void ThreadPoolImpl<Task, Queue>::post(Handler &&handler, size_t lane) {
+  const auto ok = tryPost(std::forward<Handler>(handler), lane);
   if (!ok) {
     throw std::runtime_error("thread pool queue is full");
   }
 }
 
+template <typename Task, template <typename> class Queue>
+template <typename Range>
+inline size_t ThreadPoolImpl<Task, Queue>::postBulk(Range &&handlers, size_t lane) {
+  const size_t total = std::ranges::size(handlers);
+  const size_t count = m_state->active_count.load(std::memory_order_relaxed);
+  Worker<Task, Queue> *const first = &getWorker();
+  Worker<Task, Queue> *worker = first;
+
+  lane = std::min(lane, m_state->lane_count - 1);
+
+  auto it = std::ranges::begin(handlers);
+  size_t posted = 0;
+  // Fall back to siblings when the chosen worker's queue is full
+  for (size_t i = 0; i < std::max<size_t>(count, 1u) && posted < total; ++i) {
+    const size_t n = worker->postBulk(it, total - posted, lane);
+    std::ranges::advance(it, n);
+    posted += n;
+    worker = &m_state->nextWorker();
+  }
+
+  if (posted != 0) {
+    m_state->idle.notifyN(posted);
+    m_state->checkHighWatermark(posted);
+  }
+  if (posted != total) {
+    first->counters().rejected.fetch_add(total - posted, std::memory_order_relaxed);
+  }
+  return posted;
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Handler, typename Rep, typename Period>
+inline TimerHandle ThreadPoolImpl<Task, Queue>::postAfter(const std::chrono::duration<Rep, Period> &delay,
+                                                          Handler &&handler, size_t lane) {
+  return postAt(std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(delay),
+                std::forward<Handler>(handler), lane);
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Handler>
+inline TimerHandle ThreadPoolImpl<Task, Queue>::postAt(std::chrono::steady_clock::time_point deadline,
+                                                       Handler &&handler, size_t lane) {
+  using namespace std::chrono;
+
+  // Same clock as detail::monotonicNs
+  const auto since_epoch = duration_cast<nanoseconds>(deadline.time_since_epoch()).count();
+  const uint64_t deadline_ns = uint64_t(std::max<int64_t>(since_epoch, 0));
+  const uint64_t resolution = m_state->timer_resolution_ns;
+  auto *entry = TimerWheel<Task>::create((deadline_ns + resolution - 1) / resolution,
+                                         std::min(lane, m_state->lane_count - 1), std::forward<Handler>(handler));
+
+  TimerHandle handle(entry);
+  m_state->addTimer(entry);
+  return handle;
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Handler>
+inline auto ThreadPoolImpl<Task, Queue>::submit(Handler &&handler, size_t lane)
+    -> Future<std::invoke_result_t<std::decay_t<Handler> &>> {
+  using Result = std::invoke_result_t<std::decay_t<Handler> &>;
+
+  auto *state = detail::FutureState<Result>::create(m_state->future_slab);
+  Future<Result> future(state);
+  detail::FutureTask<Result, std::decay_t<Handler>> task(state, std::decay_t<Handler>(std::forward<Handler>(handler)));
+
+  post(std::move(task), lane);
+
+  return future;
+}
+
+template <typename Task, template <typename> class Queue>
+inline ScheduleAwaiter<ThreadPoolImpl<Task, Queue>> ThreadPoolImpl<Task, Queue>::schedule(size_t lane) {
+  return ScheduleAwaiter<ThreadPoolImpl>(*this, lane);
+}
+
+template <typename Task, template <typename> class Queue>
+inline DelayAwaiter<ThreadPoolImpl<Task, Queue>>
+ThreadPoolImpl<Task, Queue>::scheduleAfter(std::chrono::steady_clock::duration delay, size_t lane) {
+  return DelayAwaiter<ThreadPoolImpl>(*this, delay, lane);
+}
+
+template <typename Task, template <typename> class Queue>
+inline void ThreadPoolImpl<Task, Queue>::spawn(CoTask<void> task, size_t lane) {
+  std::coroutine_handle<> handle = task.release();
+  try {
+    post(handle, lane);
+  } catch (...) {
+    handle.destroy();
+    throw;
+  }
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Fn>
+inline auto ThreadPoolImpl<Task, Queue>::blocking(Fn &&fn) -> std::invoke_result_t<Fn &> {
+  auto &workers = m_state->workers;
+  const auto id = Worker<Task, Queue>::getWorkerIdForCurrentThread();
+  if (id >= workers.size() || !workers[id]->isCurrentThread()) {
+    return fn();
+  }
+
+  struct Scope {
+    explicit Scope(PoolState<Task, Queue> &state) : state(state) { state.beginBlocking(); }
+    ~Scope() { state.endBlocking(); }
+    PoolState<Task, Queue> &state;
+  } scope(*m_state);
+
+  return fn();
+}
+
+template <typename Task, template <typename> class Queue> inline size_t ThreadPoolImpl<Task, Queue>::size() const {
+  return m_state->size();
+}
+
+template <typename Task, template <typename> class Queue> inline size_t ThreadPoolImpl<Task, Queue>::capacity() const {
+  size_t total = 0;
+  for (const auto &worker_ptr : m_state->workers) {
+    total = detail::addCapacity(total, worker_ptr->capacity());
+  }
+  return total;
+}
+
+template <typename Task, template <typename> class Queue> inline size_t ThreadPoolImpl<Task, Queue>::laneCount() const {
+  return m_state->lane_count;
+}
+
+template <typename Task, template <typename> class Queue>
+inline ThreadPoolStats ThreadPoolImpl<Task, Queue>::stats() const {
+  ThreadPoolStats result;
+  result.workers.reserve(m_state->workers.size());
+  for (const auto &worker_ptr : m_state->workers) {
+    result.workers.push_back(worker_ptr->stats());
+  }
+  result.threads = m_state->active_count.load(std::memory_order_relaxed);
+  result.grown = m_state->grown.load(std::memory_order_relaxed);
+  result.shrunk = m_state->shrunk.load(std::memory_order_relaxed);
+  result.compensated = m_state->compensated.load(std::memory_order_relaxed);
+  return result;
+}
+
+template <typename Task, template <typename> class Queue>
+inline size_t ThreadPoolImpl<Task, Queue>::threadCount() const {
+  return m_state->active_count.load(std::memory_order_relaxed);
+}
+
+template <typename Task, template <typename> class Queue>
+inline void ThreadPoolImpl<Task, Queue>::setResizeHandler(ResizeHandler handler) {
+  std::lock_guard lock(m_state->supervisor_mutex);
+  m_state->resize_handler = std::move(handler);
+}
+
+template <typename Task, template <typename> class Queue>
+inline void ThreadPoolImpl<Task, Queue>::setWatermarkHandler(WatermarkHandler handler) {
+  std::lock_guard lock(m_state->watermark_mutex);
+  m_state->watermark_handler = std::move(handler);
+}
+
 template <typename Task, template <typename> class Queue>
 inline Worker<Task, Queue> &ThreadPoolImpl<Task, Queue>::getWorker() {
-  auto id = Worker<Task, Queue>::getWorkerIdForCurrentThread();
+  auto &workers = m_state->workers;
+  const auto id = Worker<Task, Queue>::getWorkerIdForCurrentThread();
 
-  if (id > m_workers.size()) {
+  if (id < workers.size() && workers[id]->isCurrentThread()) {
+    return *workers[id];
   }
 
-  return *m_workers[id];
+  return m_state->nextWorker();
 }
 } // namespace tp
-} // namespace limb
\ No newline at end of file
+} // namespace limb
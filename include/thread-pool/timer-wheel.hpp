@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+namespace limb {
+namespace tp {
+
+namespace detail {
+
+/**
+ * @brief The TimerEntryBase struct is the part of a timer shared with its
+ * TimerHandle. It is reference counted: one reference is held by the wheel
+ * until the timer fires or is dropped, one by the handle.
+ */
+struct TimerEntryBase {
+  enum State : uint32_t { kPending, kFired, kCancelled };
+
+  /// Destroys the entry, set by the owner which knows its task type.
+  void (*destroy)(TimerEntryBase *) = nullptr;
+  /// Destroys the task of a cancelled entry, so captured resources are freed at once.
+  void (*clear)(TimerEntryBase *) = nullptr;
+
+  std::atomic<uint32_t> state{kPending};
+  std::atomic<uint32_t> refs{1};
+
+  void ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+  void unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      destroy(this);
+    }
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief The TimerHandle class refers to a delayed task, see
+ * ThreadPool::postAfter. It may outlive the pool.
+ */
+class TimerHandle {
+public:
+  TimerHandle() = default;
+
+  explicit TimerHandle(detail::TimerEntryBase *entry) : m_entry(entry) {
+    if (m_entry) {
+      m_entry->ref();
+    }
+  }
+
+  TimerHandle(const TimerHandle &rhs) : TimerHandle(rhs.m_entry) {}
+
+  TimerHandle(TimerHandle &&rhs) noexcept : m_entry(std::exchange(rhs.m_entry, nullptr)) {}
+
+  TimerHandle &operator=(TimerHandle rhs) noexcept {
+    std::swap(m_entry, rhs.m_entry);
+    return *this;
+  }
+
+  ~TimerHandle() {
+    if (m_entry) {
+      m_entry->unref();
+    }
+  }
+
+  /**
+   * @brief cancel Prevent the task from running.
+   * @return 'true' if the task was pending and will not run, 'false' if it
+   * has already been posted to the pool or cancelled.
+   */
+  bool cancel() {
+    uint32_t expected = detail::TimerEntryBase::kPending;
+    if (!m_entry || !m_entry->state.compare_exchange_strong(expected, detail::TimerEntryBase::kCancelled,
+                                                            std::memory_order_acq_rel)) {
+      return false;
+    }
+    m_entry->clear(m_entry);
+    return true;
+  }
+
+  /**
+   * @brief isPending Check whether the task still waits for its deadline.
+   */
+  bool isPending() const {
+    return m_entry && m_entry->state.load(std::memory_order_acquire) == detail::TimerEntryBase::kPending;
+  }
+
+private:
+  detail::TimerEntryBase *m_entry = nullptr;
+};
+
+/**
+ * @brief The TimerWheel class implements hierarchical timing wheel.
+ * Time is counted in ticks. Every level has SLOT_COUNT slots, a level covers
+ * SLOT_COUNT times longer span than the previous one. Timer is put on the
+ * level of the highest 6-bit digit in which its deadline differs from the
+ * current tick and is moved to lower levels when the current tick reaches
+ * its slot, so insertion and expiration are O(1). Deadlines further than the
+ * wheel span wait in the overflow list. Advancing skips empty slots, so the
+ * cost does not depend on the time elapsed.
+ * Class is not thread safe, the pool guards it with a mutex.
+ */
+template <typename Task> class TimerWheel {
+public:
+  static constexpr size_t SLOT_BITS = 6;
+  static constexpr size_t SLOT_COUNT = size_t(1) << SLOT_BITS;
+  static constexpr size_t LEVEL_COUNT = 4;
+  /// Returned by nextTick if there are no timers.
+  static constexpr uint64_t NEVER = UINT64_MAX;
+
+  struct Entry : detail::TimerEntryBase {
+    Entry *next = nullptr;
+    uint64_t tick = 0;
+    size_t lane = 0;
+    Task task;
+  };
+
+  /**
+   * @brief create Allocate entry holding one reference.
+   * @param tick Deadline tick.
+   * @param lane Priority lane the task is posted to.
+   * @param task Task to be posted.
+   */
+  template <typename Handler> static Entry *create(uint64_t tick, size_t lane, Handler &&task);
+
+  /**
+   * @brief TimerWheel Constructor.
+   * @param now Current tick.
+   */
+  explicit TimerWheel(uint64_t now = 0);
+
+  ~TimerWheel();
+
+  /**
+   * @brief add Schedule task, the wheel takes over the entry reference.
+   * @param entry Entry with the task and its deadline tick set. Deadline
+   * which has already passed expires on the next tick.
+   */
+  void add(Entry *entry);
+
+  /**
+   * @brief advance Move current tick forward.
+   * @param now New current tick.
+   * @param expired List the expired entries are appended to, linked by
+   * 'next'. The caller owns their references.
+   */
+  void advance(uint64_t now, Entry *&expired);
+
+  /**
+   * @brief nextTick Return tick at which advance has something to do, a
+   * timer may expire or move to a lower level.
+   */
+  uint64_t nextTick() const;
+
+  /**
+   * @brief now Return current tick.
+   */
+  uint64_t now() const { return m_now; }
+
+  /**
+   * @brief empty Check whether there are no timers.
+   */
+  bool empty() const { return m_count == 0; }
+
+private:
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  struct Level {
+    std::array<Entry *, SLOT_COUNT> slots{};
+    /// Bit per non-empty slot.
+    uint64_t occupied = 0;
+  };
+
+  void place(Entry *entry, Entry *&expired);
+  void processTick(Entry *&expired);
+
+  uint64_t m_now;
+  size_t m_count;
+  std::array<Level, LEVEL_COUNT> m_levels;
+  Entry *m_overflow;
+};
+
+/// Implementation
+
+template <typename Task>
+inline TimerWheel<Task>::TimerWheel(uint64_t now) : m_now(now), m_count(0), m_overflow(nullptr) {}
+
+template <typename Task> inline TimerWheel<Task>::~TimerWheel() {
+  auto drop = [](Entry *head) {
+    while (head) {
+      Entry *entry = std::exchange(head, head->next);
+      uint32_t expected = detail::TimerEntryBase::kPending;
+      entry->state.compare_exchange_strong(expected, detail::TimerEntryBase::kCancelled, std::memory_order_relaxed);
+      entry->unref();
+    }
+  };
+  for (Level &level : m_levels) {
+    for (Entry *head : level.slots) {
+      drop(head);
+    }
+  }
+  drop(m_overflow);
+}
+
+template <typename Task>
+template <typename Handler>
+inline typename TimerWheel<Task>::Entry *TimerWheel<Task>::create(uint64_t tick, size_t lane, Handler &&task) {
+  Entry *entry = new Entry;
+  entry->destroy = [](detail::TimerEntryBase *base) { delete static_cast<Entry *>(base); };
+  entry->clear = [](detail::TimerEntryBase *base) { static_cast<Entry *>(base)->task = Task(); };
+  entry->tick = tick;
+  entry->lane = lane;
+  entry->task = Task(std::forward<Handler>(task));
+  return entry;
+}
+
+template <typename Task> inline void TimerWheel<Task>::place(Entry *entry, Entry *&expired) {
+  if (entry->tick <= m_now) {
+    --m_count;
+    entry->next = expired;
+    expired = entry;
+    return;
+  }
+
+  const size_t level = (63 - std::countl_zero(entry->tick ^ m_now)) / SLOT_BITS;
+  if (level >= LEVEL_COUNT) {
+    entry->next = m_overflow;
+    m_overflow = entry;
+    return;
+  }
+
+  const size_t slot = (entry->tick >> (level * SLOT_BITS)) & (SLOT_COUNT - 1);
+  entry->next = m_levels[level].slots[slot];
+  m_levels[level].slots[slot] = entry;
+  m_levels[level].occupied |= uint64_t(1) << slot;
+}
+
+template <typename Task> inline void TimerWheel<Task>::add(Entry *entry) {
+  entry->tick = std::max(entry->tick, m_now + 1);
+  ++m_count;
+  Entry *expired = nullptr;
+  place(entry, expired);
+}
+
+template <typename Task> inline void TimerWheel<Task>::processTick(Entry *&expired) {
+  auto replace = [this, &expired](Entry *head) {
+    while (head) {
+      place(std::exchange(head, head->next), expired);
+    }
+  };
+
+  constexpr uint64_t span_mask = (uint64_t(1) << (LEVEL_COUNT * SLOT_BITS)) - 1;
+  if ((m_now & span_mask) == 0) {
+    replace(std::exchange(m_overflow, nullptr));
+  }
+
+  // Higher levels first, their timers may land in lower slots due this tick
+  for (size_t level = LEVEL_COUNT; level-- > 0;) {
+    const uint64_t low_mask = (uint64_t(1) << (level * SLOT_BITS)) - 1;
+    if ((m_now & low_mask) != 0) {
+      continue;
+    }
+    const size_t slot = (m_now >> (level * SLOT_BITS)) & (SLOT_COUNT - 1);
+    m_levels[level].occupied &= ~(uint64_t(1) << slot);
+    replace(std::exchange(m_levels[level].slots[slot], nullptr));
+  }
+}
+
+template <typename Task> inline uint64_t TimerWheel<Task>::nextTick() const {
+  uint64_t next = NEVER;
+  for (size_t level = 0; level < LEVEL_COUNT; ++level) {
+    const size_t shift = level * SLOT_BITS;
+    const size_t current = (m_now >> shift) & (SLOT_COUNT - 1);
+    // Timers of a level are always in slots after the current one
+    const uint64_t ahead = current + 1 < SLOT_COUNT ? m_levels[level].occupied >> (current + 1) : 0;
+    if (ahead == 0) {
+      continue;
+    }
+    const uint64_t slot = current + 1 + std::countr_zero(ahead);
+    const uint64_t base = (m_now >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+    next = std::min(next, base | (slot << shift));
+  }
+  if (m_overflow) {
+    constexpr size_t span_bits = LEVEL_COUNT * SLOT_BITS;
+    next = std::min(next, ((m_now >> span_bits) + 1) << span_bits);
+  }
+  return next;
+}
+
+template <typename Task> inline void TimerWheel<Task>::advance(uint64_t now, Entry *&expired) {
+  while (m_now < now) {
+    const uint64_t next = m_count != 0 ? nextTick() : NEVER;
+    if (next > now) {
+      m_now = now;
+      return;
+    }
+    m_now = next;
+    processTick(expired);
+  }
+}
+
+} // namespace tp
+} // namespace limb
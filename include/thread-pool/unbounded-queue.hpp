@@ -0,0 +1,383 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+namespace limb {
+namespace tp {
+
+/**
+ * @brief The MPMCUnboundedQueue class implements unbounded
+ * multi-producers/multi-consumers queue built from linked fixed-size
+ * segments. It has the same interface as MPMCBoundedQueue, so it can be used
+ * as thread pool Queue policy, but push never fails.
+ * Producers claim positions with a single fetch_add, consumers with a CAS, as
+ * in MPMCBoundedQueue a consumer may not pass an element whose producer was
+ * preempted between claim and publish.
+ * Consumed segments are recycled through a free list. Segment memory is kept
+ * until the queue is destroyed: stale pointers to recycled segments are
+ * detected by their id, so they must stay readable.
+ * Doesn't accept non-movable types as T.
+ */
+template <typename T> class MPMCUnboundedQueue {
+  static_assert(std::is_move_constructible<T>::value, "Should be of movable type");
+
+public:
+  /**
+   * @brief MPMCUnboundedQueue Constructor.
+   * @param size Power of 2 number - segment length.
+   * @throws std::invalid_argument if size is bad.
+   */
+  explicit MPMCUnboundedQueue(size_t size);
+
+  ~MPMCUnboundedQueue();
+
+  /**
+   * @brief push Push data to queue.
+   * @param data Data to be pushed.
+   * @return Always true, the signature matches MPMCBoundedQueue.
+   */
+  template <typename U> bool push(U &&data);
+
+  /**
+   * @brief pushN Push count elements to queue, claiming their positions with
+   * a single fetch_add.
+   * @param first Iterator to elements to be pushed, they are assigned to
+   * queue cells with 'cell = *first', use std::move_iterator to move them.
+   * @param count Number of elements.
+   * @return Number of pushed elements, always count.
+   */
+  template <typename It> size_t pushN(It first, size_t count);
+
+  /**
+   * @brief pop Pop data from queue.
+   * @param data Place to store popped data.
+   * @return true on sucess.
+   */
+  bool pop(T &data);
+
+  /**
+   * @brief popN Pop up to count elements from queue, reserving their cells
+   * with a single CAS. Elements are taken from a single segment.
+   * @param out Output iterator, popped elements are moved to it.
+   * @param count Maximum number of elements.
+   * @return Number of popped elements.
+   */
+  template <typename It> size_t popN(It out, size_t count);
+
+  /**
+   * @brief size Approximate number of elements in the queue.
+   */
+  size_t size() const;
+
+  /**
+   * @brief capacity Maximum number of elements in the queue, the largest
+   * size_t value.
+   */
+  size_t capacity() const;
+
+private:
+  MPMCUnboundedQueue(const MPMCUnboundedQueue &) = delete;
+  MPMCUnboundedQueue &operator=(const MPMCUnboundedQueue &) = delete;
+
+  /// Id of a segment sitting in the free list.
+  static constexpr size_t RETIRED = std::numeric_limits<size_t>::max();
+
+  struct Cell {
+    std::atomic<size_t> sequence{0};
+    T data;
+  };
+
+  struct Segment {
+    explicit Segment(size_t size)
+        : id(0), next(nullptr), released(0), free_next(nullptr), all_next(nullptr), cells(size) {}
+
+    /// Index of the segment: its first position divided by segment length.
+    std::atomic<size_t> id;
+    std::atomic<Segment *> next;
+    /// Number of consumed cells plus one when the segment became the head.
+    std::atomic<size_t> released;
+    Segment *free_next;
+    Segment *all_next;
+    std::vector<Cell> cells;
+  };
+
+  Segment *findSegment(size_t id, bool wait);
+  Segment *nextOf(Segment *segment, size_t id);
+  void link(Segment *segment);
+  void release(Segment *segment, size_t count);
+  Segment *acquireSegment();
+  void recycleSegment(Segment *segment);
+
+private:
+  typedef char Cacheline[64];
+
+  Cacheline pad0;
+  /* const */ size_t m_segment_size;
+  /* const */ size_t m_segment_shift;
+  std::atomic<Segment *> m_all;
+  std::atomic<Segment *> m_free;
+  Cacheline pad1;
+  std::atomic<Segment *> m_head;
+  std::atomic<size_t> m_dequeue_pos;
+  Cacheline pad2;
+  std::atomic<Segment *> m_tail;
+  std::atomic<size_t> m_enqueue_pos;
+  Cacheline pad3;
+};
+
+/// Implementation
+
+template <typename T>
+inline MPMCUnboundedQueue<T>::MPMCUnboundedQueue(size_t size)
+    : m_segment_size(size), m_segment_shift(0), m_all(nullptr), m_free(nullptr), m_head(nullptr), m_dequeue_pos(0),
+      m_tail(nullptr), m_enqueue_pos(0) {
+  bool size_is_power_of_2 = (size >= 2) && ((size & (size - 1)) == 0);
+  if (!size_is_power_of_2) {
+    throw std::invalid_argument("buffer size should be a power of 2");
+  }
+  while ((size_t(1) << m_segment_shift) < size) {
+    ++m_segment_shift;
+  }
+
+  Segment *first = acquireSegment();
+  first->id.store(0, std::memory_order_relaxed);
+  // The first segment starts as the head
+  first->released.store(1, std::memory_order_relaxed);
+  m_head.store(first, std::memory_order_relaxed);
+  m_tail.store(first, std::memory_order_relaxed);
+}
+
+template <typename T> inline MPMCUnboundedQueue<T>::~MPMCUnboundedQueue() {
+  Segment *segment = m_all.load(std::memory_order_relaxed);
+  while (segment) {
+    Segment *next = segment->all_next;
+    delete segment;
+    segment = next;
+  }
+}
+
+template <typename T> template <typename U> inline bool MPMCUnboundedQueue<T>::push(U &&data) {
+  const size_t pos = m_enqueue_pos.fetch_add(1, std::memory_order_relaxed);
+  const size_t index = pos & (m_segment_size - 1);
+
+  Segment *segment = findSegment(pos >> m_segment_shift, true);
+  if (index == 0) {
+    link(segment);
+  }
+
+  Cell &cell = segment->cells[index];
+  cell.data = std::forward<U>(data);
+  cell.sequence.store(pos + 1, std::memory_order_release);
+
+  return true;
+}
+
+template <typename T> template <typename It> inline size_t MPMCUnboundedQueue<T>::pushN(It first, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  const size_t pos = m_enqueue_pos.fetch_add(count, std::memory_order_relaxed);
+
+  Segment *segment = nullptr;
+  for (size_t i = 0; i < count; ++i, ++first) {
+    const size_t index = (pos + i) & (m_segment_size - 1);
+    if (segment == nullptr || index == 0) {
+      segment = findSegment((pos + i) >> m_segment_shift, true);
+      if (index == 0) {
+        link(segment);
+      }
+    }
+
+    Cell &cell = segment->cells[index];
+    cell.data = *first;
+    cell.sequence.store(pos + i + 1, std::memory_order_release);
+  }
+
+  return count;
+}
+
+template <typename T> inline bool MPMCUnboundedQueue<T>::pop(T &data) {
+  return popN(&data, 1) == 1;
+}
+
+template <typename T> template <typename It> inline size_t MPMCUnboundedQueue<T>::popN(It out, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  Segment *segment;
+  size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  size_t reserved;
+  for (;;) {
+    const size_t index = pos & (m_segment_size - 1);
+    segment = findSegment(pos >> m_segment_shift, false);
+
+    // Producers publish cells out of order, so every cell of the range is checked
+    reserved = 0;
+    while (segment && reserved < count && index + reserved < m_segment_size) {
+      const size_t seq = segment->cells[index + reserved].sequence.load(std::memory_order_acquire);
+      if (seq != pos + reserved + 1) {
+        break;
+      }
+      ++reserved;
+    }
+
+    if (reserved == 0) {
+      // The segment may have been consumed and recycled under us, only a
+      // position nobody moved means the queue is empty
+      const size_t current = m_dequeue_pos.load(std::memory_order_relaxed);
+      if (current == pos) {
+        return 0;
+      }
+      pos = current;
+      continue;
+    }
+
+    if (m_dequeue_pos.compare_exchange_weak(pos, pos + reserved, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  const size_t index = pos & (m_segment_size - 1);
+  for (size_t i = 0; i < reserved; ++i, ++out) {
+    *out = std::move(segment->cells[index + i].data);
+  }
+  release(segment, reserved);
+
+  return reserved;
+}
+
+template <typename T> inline size_t MPMCUnboundedQueue<T>::size() const {
+  const size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  const size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0u;
+}
+
+template <typename T> inline size_t MPMCUnboundedQueue<T>::capacity() const {
+  return std::numeric_limits<size_t>::max();
+}
+
+template <typename T>
+inline typename MPMCUnboundedQueue<T>::Segment *MPMCUnboundedQueue<T>::findSegment(size_t id, bool wait) {
+  for (;;) {
+    // Both pointers are only hints and may point to a recycled segment, but
+    // head is never past a position that is not consumed yet
+    Segment *segment = (wait ? m_tail : m_head).load(std::memory_order_acquire);
+    size_t current = segment->id.load(std::memory_order_acquire);
+    if (current > id) {
+      segment = m_head.load(std::memory_order_acquire);
+      current = segment->id.load(std::memory_order_acquire);
+      if (current == RETIRED || m_head.load(std::memory_order_acquire) != segment) {
+        continue;
+      }
+      if (current > id) {
+        // Only a consumer with a stale position gets here
+        return nullptr;
+      }
+    }
+
+    Segment *next = nullptr;
+    while (current < id && (next = nextOf(segment, current)) != nullptr) {
+      segment = next;
+      current = segment->id.load(std::memory_order_acquire);
+    }
+
+    if (current == id) {
+      return segment;
+    }
+    if (current < id && segment->id.load(std::memory_order_relaxed) == current) {
+      // Segment is not linked yet: producer of its predecessor's first cell
+      // is still busy
+      if (!wait) {
+        return nullptr;
+      }
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename T>
+inline typename MPMCUnboundedQueue<T>::Segment *MPMCUnboundedQueue<T>::nextOf(Segment *segment, size_t id) {
+  Segment *next = segment->next.load(std::memory_order_acquire);
+  // The segment might have been recycled while next was read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (segment->id.load(std::memory_order_relaxed) != id) {
+    return nullptr;
+  }
+  return next;
+}
+
+template <typename T> inline void MPMCUnboundedQueue<T>::link(Segment *segment) {
+  // Called by the producer of the segment's first cell, the segment can't be
+  // recycled until that cell is published. Next segment is linked one step
+  // ahead, so producers rarely wait for it
+  m_tail.store(segment, std::memory_order_release);
+  Segment *next = acquireSegment();
+  next->next.store(nullptr, std::memory_order_relaxed);
+  next->released.store(0, std::memory_order_relaxed);
+  next->id.store(segment->id.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+  segment->next.store(next, std::memory_order_release);
+}
+
+template <typename T> inline void MPMCUnboundedQueue<T>::release(Segment *segment, size_t count) {
+  // Segments are recycled in order: a segment is done when all its cells are
+  // consumed and its predecessor has handed the head over to it
+  while (segment->released.fetch_add(count, std::memory_order_acq_rel) + count == m_segment_size + 1) {
+    Segment *next = segment->next.load(std::memory_order_acquire);
+    m_head.store(next, std::memory_order_release);
+    recycleSegment(segment);
+
+    segment = next;
+    count = 1;
+  }
+}
+
+template <typename T> inline typename MPMCUnboundedQueue<T>::Segment *MPMCUnboundedQueue<T>::acquireSegment() {
+  // Free list is taken as a whole, so it doesn't suffer from ABA
+  Segment *segment = m_free.exchange(nullptr, std::memory_order_acquire);
+  if (segment) {
+    Segment *rest = segment->free_next;
+    if (rest) {
+      Segment *last = rest;
+      while (last->free_next) {
+        last = last->free_next;
+      }
+      Segment *top = m_free.load(std::memory_order_relaxed);
+      do {
+        last->free_next = top;
+      } while (!m_free.compare_exchange_weak(top, rest, std::memory_order_release, std::memory_order_relaxed));
+    }
+    return segment;
+  }
+
+  segment = new Segment(m_segment_size);
+  Segment *all = m_all.load(std::memory_order_relaxed);
+  do {
+    segment->all_next = all;
+  } while (!m_all.compare_exchange_weak(all, segment, std::memory_order_release, std::memory_order_relaxed));
+  return segment;
+}
+
+template <typename T> inline void MPMCUnboundedQueue<T>::recycleSegment(Segment *segment) {
+  // Release pairs with findSegment(): whoever sees the segment retired also
+  // sees the head moved past it
+  segment->id.store(RETIRED, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->next.store(nullptr, std::memory_order_relaxed);
+
+  Segment *top = m_free.load(std::memory_order_relaxed);
+  do {
+    segment->free_next = top;
+  } while (!m_free.compare_exchange_weak(top, segment, std::memory_order_release, std::memory_order_relaxed));
+}
+
+} // namespace tp
+} // namespace limb
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+namespace limb {
+namespace tp {
+
+/**
+ * @brief The WorkStealingQueue class implements bounded single-owner
+ * work-stealing deque.
+ * The owner thread pushes and pops at the bottom (LIFO), any other thread
+ * may steal from the top (FIFO).
+ * Doesn't accept non-movable types as T.
+ * Based on Chase-Lev deque with fixed buffer. Thieves claim a cell before
+ * moving data out of it, and every cell carries a sequence number, so the
+ * owner never overwrites a cell that is still being drained by a thief.
+ * https://www.dre.vanderbilt.edu/~schmidt/PDF/work-stealing-dequeue.pdf
+ */
+template <typename T> class WorkStealingQueue {
+  static_assert(std::is_move_constructible<T>::value, "Should be of movable type");
+
+public:
+  /**
+   * @brief WorkStealingQueue Constructor.
+   * @param size Power of 2 number - queue length.
+   * @throws std::invalid_argument if size is bad.
+   */
+  explicit WorkStealingQueue(size_t size);
+
+  /**
+   * @brief push Push data to the bottom of the queue. Owner thread only.
+   * @param data Data to be pushed.
+   * @return true on success.
+   */
+  template <typename U> bool push(U &&data);
+
+  /**
+   * @brief pop Pop data from the bottom of the queue. Owner thread only.
+   * @param data Place to store popped data.
+   * @return true on sucess.
+   */
+  bool pop(T &data);
+
+  /**
+   * @brief steal Pop data from the top of the queue. Any thread.
+   * @param data Place to store stolen data.
+   * @return true on sucess.
+   */
+  bool steal(T &data);
+
+  /**
+   * @brief size Approximate number of elements in the queue.
+   */
+  size_t size() const;
+
+private:
+  WorkStealingQueue(const WorkStealingQueue &) = delete;
+  WorkStealingQueue &operator=(const WorkStealingQueue &) = delete;
+
+  struct Cell {
+    std::atomic<int64_t> sequence;
+    T data;
+  };
+
+  void take(int64_t pos, T &data);
+
+private:
+  typedef char Cacheline[64];
+
+  Cacheline pad0;
+  std::vector<Cell> m_buffer;
+  /* const */ int64_t m_buffer_mask;
+  Cacheline pad1;
+  std::atomic<int64_t> m_top;
+  Cacheline pad2;
+  std::atomic<int64_t> m_bottom;
+  Cacheline pad3;
+};
+
+/// Implementation
+
+template <typename T>
+inline WorkStealingQueue<T>::WorkStealingQueue(size_t size)
+    : m_buffer(size), m_buffer_mask(int64_t(size) - 1), m_top(0), m_bottom(0) {
+  bool size_is_power_of_2 = (size >= 2) && ((size & (size - 1)) == 0);
+  if (!size_is_power_of_2) {
+    throw std::invalid_argument("buffer size should be a power of 2");
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    m_buffer[i].sequence = int64_t(i);
+  }
+}
+
+template <typename T> template <typename U> inline bool WorkStealingQueue<T>::push(U &&data) {
+  const int64_t b = m_bottom.load(std::memory_order_relaxed);
+  const int64_t t = m_top.load(std::memory_order_acquire);
+  if (b - t > m_buffer_mask) {
+    return false;
+  }
+
+  Cell &cell = m_buffer[b & m_buffer_mask];
+  // A thief may still be moving data out of this cell.
+  if (cell.sequence.load(std::memory_order_acquire) != b) {
+    return false;
+  }
+
+  cell.data = std::forward<U>(data);
+
+  m_bottom.store(b + 1, std::memory_order_release);
+
+  return true;
+}
+
+template <typename T> inline bool WorkStealingQueue<T>::pop(T &data) {
+  const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+  m_bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = m_top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (t < b) {
+    // No thief can claim this cell, and the next push goes to the same
+    // position, so its sequence stays b.
+    data = std::move(m_buffer[b & m_buffer_mask].data);
+    return true;
+  }
+
+  // Last element, race against thieves.
+  const bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  m_bottom.store(b + 1, std::memory_order_relaxed);
+  if (!won) {
+    return false;
+  }
+
+  // Taken from the top like a steal, the cell is reused one lap later.
+  take(b, data);
+
+  return true;
+}
+
+template <typename T> inline bool WorkStealingQueue<T>::steal(T &data) {
+  int64_t t = m_top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t b = m_bottom.load(std::memory_order_acquire);
+
+  if (t >= b) {
+    return false;
+  }
+
+  if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return false;
+  }
+
+  take(t, data);
+
+  return true;
+}
+
+template <typename T> inline size_t WorkStealingQueue<T>::size() const {
+  const int64_t b = m_bottom.load(std::memory_order_relaxed);
+  const int64_t t = m_top.load(std::memory_order_relaxed);
+  return b > t ? size_t(b - t) : 0u;
+}
+
+template <typename T> inline void WorkStealingQueue<T>::take(int64_t pos, T &data) {
+  Cell &cell = m_buffer[pos & m_buffer_mask];
+
+  data = std::move(cell.data);
+
+  cell.sequence.store(pos + m_buffer_mask + 1, std::memory_order_release);
+}
+
+} // namespace tp
+} // namespace limb
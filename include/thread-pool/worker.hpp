@@ -1,47 +1,277 @@
 #pragma once
 
+#include <thread-pool/cpu-topology.hpp>
+#include <thread-pool/event-count.hpp>
+#include <thread-pool/future.hpp>
+#include <thread-pool/thread-pool-stats.hpp>
+#include <thread-pool/timer-wheel.hpp>
+#include <thread-pool/work-stealing-queue.hpp>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <vector>
 
-#include <condition_variable>
 #include <thread>
 namespace limb {
 namespace tp {
 
+template <typename Task, template <typename> class Queue> class Worker;
+
 /**
- * @brief The Worker class owns task queue and executing thread.
- * In thread it tries to pop task from queue. If queue is empty then it tries
- * to steal task from the sibling worker. If steal was unsuccessful then spins
- * with one millisecond delay.
+ * @brief The QueuedTask struct is an element of worker queues: the task and
+ * the time it was queued at.
  */
-template <typename Task, template <typename> class Queue> class Worker {
-public:
+template <typename Task> struct QueuedTask {
   /**
-   * @brief Worker Constructor.
-   * @param queue_size Length of undelaying task queue.
+   * @brief The Pending struct refers to a handler which is converted to the
+   * task only when the queue accepts it, so rejected handlers stay intact.
+   */
+  template <typename Handler> struct Pending {
+    Handler &&handler;
+    uint64_t queued_at;
+  };
+
+  /**
+   * @brief The PendingIterator struct adapts iterator over handlers for bulk
+   * queue push: handlers are moved out only when cells are reserved.
+   */
+  template <typename It> struct PendingIterator {
+    using Handler = std::iter_value_t<It>;
+
+    Pending<Handler> operator*() const { return Pending<Handler>{std::move(*it), queued_at}; }
+
+    PendingIterator &operator++() {
+      ++it;
+      return *this;
+    }
+
+    It it;
+    uint64_t queued_at;
+  };
+
+  template <typename Handler> QueuedTask &operator=(Pending<Handler> &&pending) {
+    task = std::forward<Handler>(pending.handler);
+    queued_at = pending.queued_at;
+    return *this;
+  }
+
+  Task task;
+  uint64_t queued_at = 0;
+};
+
+/**
+ * @brief The PoolState struct holds state shared by the thread pool and its
+ * workers.
+ * Worker slots are preallocated up to the maximum thread count. If the pool
+ * is elastic, the supervisor thread starts a thread in a free slot when tasks
+ * wait for too long and retires workers which stay parked for longer than
+ * the keep-alive period. Slot index is the worker ID, so it is stable across
+ * restarts, and queues of retired workers stay allocated, so their remaining
+ * tasks are stolen by siblings.
+ * Extra slots are preallocated for compensating workers: a worker entering
+ * a blocking call starts one when no parked sibling may take over, they are
+ * retired by the supervisor like any other idle worker.
+ * Delayed tasks wait in the timer wheel, the timer thread is started with the
+ * first of them and posts them to workers when their deadlines pass.
+ */
+template <typename Task, template <typename> class Queue> struct PoolState {
+  using WatermarkHandler = std::function<void(bool saturated)>;
+  using ResizeHandler = std::function<void(size_t old_count, size_t new_count)>;
+
+  PoolState()
+      : next_worker(0), started(false), lane_count(1), aging_interval(8), low_watermark(0), high_watermark(0),
+        queued(0), saturated(false), future_slab(nullptr), min_threads(0), max_threads(0), grow_threshold_ns(0),
+        keep_alive_ns(0), max_compensation(0), active_count(0), blocked_count(0), grow_requested(false), grown(0),
+        shrunk(0), compensated(0), supervisor_stop(false), timer_resolution_ns(0), timer_stop(false) {}
+
+  ~PoolState() {
+    if (future_slab) {
+      future_slab->release();
+    }
+  }
+
+  /**
+   * @brief size Approximate number of queued tasks in all workers.
+   */
+  size_t size() const;
+
+  /**
+   * @brief checkHighWatermark Count posted tasks and report saturation if
+   * occupancy reached high watermark. Called after tasks are posted.
+   * @param posted Number of tasks posted.
+   */
+  void checkHighWatermark(size_t posted);
+
+  /**
+   * @brief checkLowWatermark Count taken task and report drain if saturated
+   * pool occupancy fell to low watermark. Called after task is taken.
+   */
+  void checkLowWatermark();
+
+  /**
+   * @brief nextWorker Return next running worker in round-robin order.
+   */
+  Worker<Task, Queue> &nextWorker();
+
+  /**
+   * @brief isElastic Check whether thread count may change.
    */
-  explicit Worker(std::shared_ptr<Queue<Task>> qtptr);
+  bool isElastic() const;
 
   /**
-   * @brief Move ctor implementation.
+   * @brief needsSupervisor Check whether idle workers may have to be retired.
    */
-  Worker(Worker &&rhs) noexcept;
+  bool needsSupervisor() const;
 
   /**
-   * @brief Move assignment implementaion.
+   * @brief supervise Supervisor thread function, resizes the pool until
+   * supervisor_stop is set.
    */
-  Worker &operator=(Worker &&rhs) noexcept;
+  void supervise();
 
   /**
-   * @brief start Create the executing thread and start tasks execution.
+   * @brief tryGrow Start one more worker if tasks wait for longer than grow
+   * threshold.
+   */
+  bool tryGrow();
+
+  /**
+   * @brief tryShrink Retire one worker parked for longer than keep-alive.
+   */
+  bool tryShrink();
+
+  /**
+   * @brief beginBlocking Called by worker about to block: wakes a parked
+   * sibling or starts a compensating worker if runnable workers fall below
+   * the maximal thread count.
+   */
+  void beginBlocking();
+
+  /**
+   * @brief endBlocking Called by worker returned from blocking call.
+   */
+  void endBlocking();
+
+  /**
+   * @brief addTimer Put entry into the timer wheel and start the timer
+   * thread if it is not running yet.
+   * @param entry Entry with the deadline tick set, the wheel takes over its
+   * reference.
+   */
+  void addTimer(typename TimerWheel<Task>::Entry *entry);
+
+  /**
+   * @brief runTimers Timer thread function, posts expired tasks until
+   * timer_stop is set.
+   */
+  void runTimers();
+
+  /**
+   * @brief postExpired Post tasks of expired timers to workers.
+   * @return Entries which didn't fit into the queues.
+   */
+  typename TimerWheel<Task>::Entry *postExpired(typename TimerWheel<Task>::Entry *expired);
+
+  std::vector<std::unique_ptr<Worker<Task, Queue>>> workers;
+  std::atomic<size_t> next_worker;
+  /// Set when all workers are created, workers don't touch siblings before.
+  std::atomic<bool> started;
+
+  size_t lane_count;
+  size_t aging_interval;
+
+  EventCount idle;
+
+  size_t low_watermark;
+  size_t high_watermark;
+  /// Approximate occupancy compared to the watermarks, counted only when they
+  /// are set. Briefly negative when a task is taken before its post is counted.
+  alignas(64) std::atomic<int64_t> queued;
+  std::atomic<bool> saturated;
+  std::mutex watermark_mutex;
+  WatermarkHandler watermark_handler;
+
+  FutureSlab *future_slab;
+
+  size_t min_threads;
+  size_t max_threads;
+  uint64_t grow_threshold_ns;
+  uint64_t keep_alive_ns;
+  size_t max_compensation;
+  std::vector<std::vector<size_t>> placement;
+  std::atomic<size_t> active_count;
+  std::atomic<size_t> blocked_count;
+  std::atomic<bool> grow_requested;
+  std::atomic<uint64_t> grown;
+  std::atomic<uint64_t> shrunk;
+  std::atomic<uint64_t> compensated;
+  /// Serializes starting and retiring workers.
+  std::mutex resize_mutex;
+
+  std::mutex supervisor_mutex;
+  std::condition_variable supervisor_cv;
+  bool supervisor_stop;
+  ResizeHandler resize_handler;
+  std::thread supervisor;
+
+  uint64_t timer_resolution_ns;
+  std::mutex timer_mutex;
+  std::condition_variable timer_cv;
+  TimerWheel<Task> timers;
+  bool timer_stop;
+  std::thread timer;
+};
+
+/**
+ * @brief The Worker class owns task queues and executing thread.
+ * Every worker owns a work-stealing deque for tasks posted from the worker
+ * itself and an inbox queue for tasks posted from foreign threads, one pair
+ * per priority lane.
+ * In thread it walks the lanes from the highest priority one: it tries to pop
+ * task from the deque, then from the inbox, then to steal task from a random
+ * sibling worker. Every 'aging interval'-th walk starts from a lower lane, so
+ * low priority tasks are not starved. If nothing was found then it spins for a
+ * short while and parks on the pool's event count until a new task is posted.
+ * Every worker keeps its own counters and latency histograms, see
+ * WorkerCounters.
+ * Queues are allocated by the executing thread after it is pinned to its
+ * CPUs, so that their memory is placed on the worker's NUMA node. They
+ * outlive the thread: a worker may be retired and started again.
+ */
+template <typename Task, template <typename> class Queue> class Worker {
+public:
+  /// Number of unsuccessful task lookups before worker parks.
+  static constexpr size_t SPIN_COUNT = 64;
+
+  /**
+   * @brief Worker Constructor.
+   * @param queue_size Length of undelaying task queues.
+   * @param lane_count Number of priority lanes.
+   */
+  Worker(size_t queue_size, size_t lane_count);
+
+  /**
+   * @brief start Create the executing thread and wait until it allocates its
+   * queues. Tasks execution starts when PoolState::started is set. Worker
+   * may be started again after it was stopped and joined.
    * @param id Worker ID.
-   * @param cv Varible that indicated that a new element is pushed on a queue.
+   * @param state State of the pool this worker belongs to.
+   * @param cpus CPUs to pin the thread to, empty set means no pinning.
+   * @throws Exception thrown while allocating the queues.
    */
-  void start(size_t id, std::condition_variable &cv);
+  void start(size_t id, PoolState<Task, Queue> &state, std::vector<size_t> cpus);
 
   /**
    * @brief instructs worker that he should terminane on next iteration.
+   * Worker stops accepting tasks from foreign threads at once.
    */
   void stop();
 
@@ -50,6 +280,84 @@ public:
    */
   void join();
 
+  /**
+   * @brief isActive Check whether worker has running thread which accepts
+   * tasks.
+   */
+  bool isActive() const;
+
+  /**
+   * @brief isAllocated Check whether worker queues are allocated, i.e. it was
+   * started at least once.
+   */
+  bool isAllocated() const;
+
+  /**
+   * @brief idleSince Return time the worker parked at, zero if it is not
+   * parked.
+   */
+  uint64_t idleSince() const;
+
+  /**
+   * @brief busySince Return time the worker started current task at, zero if
+   * it doesn't execute any.
+   */
+  uint64_t busySince() const;
+
+  /**
+   * @brief post Post task to the worker. Tasks posted from the worker's own
+   * thread go to its local deque, tasks from other threads go to the inbox.
+   * @param handler Handler to be posted.
+   * @param lane Priority lane.
+   * @return 'true' on success, false if the queue is full.
+   */
+  template <typename Handler> bool post(Handler &&handler, size_t lane);
+
+  /**
+   * @brief postBulk Post several tasks to the worker. Tasks posted from the
+   * worker's own thread go to its local deque while it has space, the rest
+   * go to the inbox which is filled with a single CAS.
+   * @param first Iterator to handlers, accepted ones are moved from.
+   * @param count Number of handlers.
+   * @param lane Priority lane.
+   * @return Number of posted handlers, the first ones of the range.
+   */
+  template <typename It> size_t postBulk(It first, size_t count, size_t lane);
+
+  /**
+   * @brief steal Steal task from this worker.
+   * @param task Place to store stolen task.
+   * @param lane Priority lane.
+   * @return 'true' on success.
+   */
+  bool steal(QueuedTask<Task> &task, size_t lane);
+
+  /**
+   * @brief size Approximate number of tasks queued in this worker.
+   */
+  size_t size() const;
+
+  /**
+   * @brief capacity Number of tasks that can be queued in this worker from
+   * foreign threads.
+   */
+  size_t capacity() const;
+
+  /**
+   * @brief counters Return counters of this worker.
+   */
+  WorkerCounters &counters();
+
+  /**
+   * @brief stats Return snapshot of this worker's counters.
+   */
+  WorkerStats stats() const;
+
+  /**
+   * @brief isCurrentThread Check whether the caller runs on this worker.
+   */
+  bool isCurrentThread() const;
+
   /**
    * @brief getWorkerIdForCurrentThread Return worker ID associated with
    * current thread if exists.
@@ -61,12 +369,52 @@ private:
   /**
    * @brief threadFunc Executing thread function.
    * @param id Worker ID to be associated with this thread.
-   * @param cv Varible that indicated that a new element is pushed on a queue.
+   * @param state State of the pool this worker belongs to.
+   * @param cpus CPUs to pin the thread to.
+   * @param ready Promise fulfilled when queues are allocated.
+   */
+  void threadFunc(size_t id, PoolState<Task, Queue> &state, std::vector<size_t> cpus, std::promise<void> ready);
+
+  /**
+   * @brief getTask Take task from own queues or steal it from siblings.
+   */
+  bool getTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state);
+
+  /**
+   * @brief getTask Take task of given lane from own queues or steal it from
+   * siblings.
    */
-  void threadFunc(size_t id, std::condition_variable &cv);
+  bool getTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state, size_t lane);
+
+  /**
+   * @brief waitTask Spin and then park until a task is available or the
+   * worker is stopped.
+   * @return 'true' if task was taken.
+   */
+  bool waitTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state);
+
+  size_t nextRandom();
+
+  struct Lane {
+    explicit Lane(size_t queue_size) : local(queue_size), inbox(queue_size) {}
+
+    WorkStealingQueue<QueuedTask<Task>> local;
+    Queue<QueuedTask<Task>> inbox;
+  };
+
+  size_t m_queue_size;
+  std::vector<std::unique_ptr<Lane>> m_lanes;
+
+  WorkerCounters m_counters;
+
+  std::atomic<bool> m_allocated;
+  std::atomic<bool> m_active;
+  std::atomic<uint64_t> m_idle_since;
+  std::atomic<uint64_t> m_busy_since;
 
-  std::shared_ptr<Queue<Task>> m_queue;
-  std::mutex available_handler;
+  size_t m_rng_state;
+  size_t m_picks;
+  size_t m_aging_round;
 
   std::atomic<bool> m_running_flag;
   std::thread m_thread;
@@ -79,34 +427,456 @@ inline size_t *thread_id() {
   static thread_local size_t tss_id = -1u;
   return &tss_id;
 }
+
+inline const void **thread_worker() {
+  static thread_local const void *tss_worker = nullptr;
+  return &tss_worker;
+}
+
+/**
+ * @brief addCapacity Sum queue capacities, unbounded queues report the
+ * largest size_t value.
+ */
+inline size_t addCapacity(size_t total, size_t capacity) {
+  return capacity > SIZE_MAX - total ? SIZE_MAX : total + capacity;
+}
 } // namespace detail
 
+template <typename Task, template <typename> class Queue> inline size_t PoolState<Task, Queue>::size() const {
+  size_t total = 0;
+  for (const auto &worker_ptr : workers) {
+    total += worker_ptr->size();
+  }
+  return total;
+}
+
+template <typename Task, template <typename> class Queue>
+inline void PoolState<Task, Queue>::checkHighWatermark(size_t posted) {
+  if (high_watermark == 0) {
+    return;
+  }
+  const int64_t occupancy = queued.fetch_add(int64_t(posted), std::memory_order_relaxed) + int64_t(posted);
+  if (saturated.load(std::memory_order_relaxed) || occupancy < int64_t(high_watermark)) {
+    return;
+  }
+
+  std::lock_guard lock(watermark_mutex);
+  if (!saturated.load(std::memory_order_relaxed) && queued.load(std::memory_order_relaxed) >= int64_t(high_watermark)) {
+    saturated.store(true, std::memory_order_relaxed);
+    if (watermark_handler) {
+      watermark_handler(true);
+    }
+  }
+}
+
+template <typename Task, template <typename> class Queue> inline void PoolState<Task, Queue>::checkLowWatermark() {
+  if (high_watermark == 0) {
+    return;
+  }
+  const int64_t occupancy = queued.fetch_sub(1, std::memory_order_relaxed) - 1;
+  if (!saturated.load(std::memory_order_relaxed) || occupancy > int64_t(low_watermark)) {
+    return;
+  }
+
+  std::lock_guard lock(watermark_mutex);
+  if (saturated.load(std::memory_order_relaxed) && queued.load(std::memory_order_relaxed) <= int64_t(low_watermark)) {
+    saturated.store(false, std::memory_order_relaxed);
+    if (watermark_handler) {
+      watermark_handler(false);
+    }
+  }
+}
+
+template <typename Task, template <typename> class Queue>
+inline Worker<Task, Queue> &PoolState<Task, Queue>::nextWorker() {
+  Worker<Task, Queue> *fallback = nullptr;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    Worker<Task, Queue> *worker = workers[next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size()].get();
+    if (worker->isActive()) {
+      return *worker;
+    }
+    if (!fallback && worker->isAllocated()) {
+      fallback = worker;
+    }
+  }
+  // Worker is being retired right now, siblings will steal the task
+  return fallback ? *fallback : *workers.front();
+}
+
+template <typename Task, template <typename> class Queue> inline bool PoolState<Task, Queue>::isElastic() const {
+  return min_threads < max_threads;
+}
+
+template <typename Task, template <typename> class Queue> inline bool PoolState<Task, Queue>::needsSupervisor() const {
+  return isElastic() || max_compensation != 0;
+}
+
+template <typename Task, template <typename> class Queue> inline void PoolState<Task, Queue>::supervise() {
+  using namespace std::chrono;
+
+  // Pool which only compensates has nothing to grow
+  const uint64_t interval_ns = grow_threshold_ns != 0 ? std::min(grow_threshold_ns, keep_alive_ns) : keep_alive_ns;
+  const auto period = std::clamp<nanoseconds>(nanoseconds(interval_ns / 2), milliseconds(1), milliseconds(100));
+
+  std::unique_lock lock(supervisor_mutex);
+  while (!supervisor_cv.wait_for(lock, period, [this]() { return supervisor_stop; })) {
+    lock.unlock();
+    const size_t before = active_count.load(std::memory_order_relaxed);
+    if (!tryGrow()) {
+      tryShrink();
+    }
+    const size_t after = active_count.load(std::memory_order_relaxed);
+    lock.lock();
+
+    if (after != before && resize_handler) {
+      resize_handler(before, after);
+    }
+  }
+}
+
+template <typename Task, template <typename> class Queue> inline bool PoolState<Task, Queue>::tryGrow() {
+  if (grow_threshold_ns == 0) {
+    return false;
+  }
+
+  bool overloaded = grow_requested.exchange(false, std::memory_order_relaxed);
+  if (active_count.load(std::memory_order_relaxed) >= max_threads) {
+    return false;
+  }
+
+  // Long running tasks hold all workers and nobody dequeues to notice the wait
+  if (!overloaded && size() > 0) {
+    const uint64_t now = detail::monotonicNs();
+    overloaded = true;
+    for (const auto &worker_ptr : workers) {
+      if (!worker_ptr->isActive()) {
+        continue;
+      }
+      const uint64_t busy_since = worker_ptr->busySince();
+      if (busy_since == 0 || now - std::min(now, busy_since) < grow_threshold_ns) {
+        overloaded = false;
+        break;
+      }
+    }
+  }
+  if (!overloaded) {
+    return false;
+  }
+
+  std::lock_guard lock(resize_mutex);
+  for (size_t id = 0; id < workers.size(); ++id) {
+    if (workers[id]->isActive()) {
+      continue;
+    }
+    try {
+      workers[id]->start(id, *this, placement[id]);
+    } catch (...) {
+      // out of memory, try again later
+      return false;
+    }
+    active_count.fetch_add(1, std::memory_order_relaxed);
+    grown.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+template <typename Task, template <typename> class Queue> inline bool PoolState<Task, Queue>::tryShrink() {
+  if (active_count.load(std::memory_order_relaxed) <= min_threads) {
+    return false;
+  }
+
+  std::lock_guard lock(resize_mutex);
+  const uint64_t now = detail::monotonicNs();
+  for (size_t i = workers.size(); i-- > 0;) {
+    auto &worker = *workers[i];
+    const uint64_t idle_since = worker.idleSince();
+    if (!worker.isActive() || idle_since == 0 || now - std::min(now, idle_since) < keep_alive_ns) {
+      continue;
+    }
+
+    worker.stop();
+    idle.notifyAll();
+    worker.join();
+
+    active_count.fetch_sub(1, std::memory_order_relaxed);
+    shrunk.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+template <typename Task, template <typename> class Queue> inline void PoolState<Task, Queue>::beginBlocking() {
+  const size_t blocked = blocked_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  const size_t active = active_count.load(std::memory_order_relaxed);
+  // Enough workers are still runnable
+  if (active > blocked && active - blocked >= max_threads) {
+    return;
+  }
+
+  // A parked sibling takes over tasks queued to the blocked worker
+  for (const auto &worker_ptr : workers) {
+    if (worker_ptr->isActive() && worker_ptr->idleSince() != 0) {
+      idle.notify();
+      return;
+    }
+  }
+
+  if (max_compensation == 0) {
+    return;
+  }
+
+  std::lock_guard lock(resize_mutex);
+  if (active_count.load(std::memory_order_relaxed) >= max_threads + max_compensation) {
+    return;
+  }
+  for (size_t id = 0; id < workers.size(); ++id) {
+    if (workers[id]->isActive()) {
+      continue;
+    }
+    try {
+      workers[id]->start(id, *this, placement[id]);
+    } catch (...) {
+      // out of memory, the blocked worker is not compensated
+      return;
+    }
+    active_count.fetch_add(1, std::memory_order_relaxed);
+    compensated.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+}
+
+template <typename Task, template <typename> class Queue> inline void PoolState<Task, Queue>::endBlocking() {
+  blocked_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
 template <typename Task, template <typename> class Queue>
-inline Worker<Task, Queue>::Worker(std::shared_ptr<Queue<Task>> qtptr) : m_queue(qtptr), m_running_flag(true) {}
+inline void PoolState<Task, Queue>::addTimer(typename TimerWheel<Task>::Entry *entry) {
+  std::lock_guard lock(timer_mutex);
+  if (timers.empty()) {
+    // Nothing to expire, the wheel just jumps to the current tick
+    typename TimerWheel<Task>::Entry *expired = nullptr;
+    timers.advance(detail::monotonicNs() / timer_resolution_ns, expired);
+  }
+
+  const bool earlier = entry->tick < timers.nextTick();
+  timers.add(entry);
+  if (timer_stop) {
+    // Pool is being destroyed, the entry is dropped with the wheel
+    return;
+  }
+  if (!timer.joinable()) {
+    timer = std::thread(&PoolState::runTimers, this);
+  } else if (earlier) {
+    timer_cv.notify_one();
+  }
+}
+
+template <typename Task, template <typename> class Queue> inline void PoolState<Task, Queue>::runTimers() {
+  using Entry = typename TimerWheel<Task>::Entry;
+
+  std::unique_lock lock(timer_mutex);
+  while (!timer_stop) {
+    Entry *expired = nullptr;
+    const uint64_t now = detail::monotonicNs();
+    timers.advance(now / timer_resolution_ns, expired);
+    if (expired) {
+      lock.unlock();
+      Entry *rejected = postExpired(expired);
+      lock.lock();
+      // Queues are full, try again on the next tick
+      while (rejected) {
+        Entry *entry = std::exchange(rejected, rejected->next);
+        entry->tick = timers.now() + 1;
+        timers.add(entry);
+      }
+      continue;
+    }
 
-template <typename Task, template <typename> class Queue> inline Worker<Task, Queue>::Worker(Worker &&rhs) noexcept {
-  *this = rhs;
+    const uint64_t next = timers.nextTick();
+    if (next == TimerWheel<Task>::NEVER) {
+      timer_cv.wait(lock);
+    } else {
+      const uint64_t deadline = next * timer_resolution_ns;
+      timer_cv.wait_for(lock, std::chrono::nanoseconds(deadline - std::min(deadline, now)));
+    }
+  }
 }
 
 template <typename Task, template <typename> class Queue>
-inline Worker<Task, Queue> &Worker<Task, Queue>::operator=(Worker &&rhs) noexcept {
-  if (this != &rhs) {
-    m_queue = std::move(rhs.m_queue);
-    m_running_flag = rhs.m_running_flag.load();
-    m_thread = std::move(rhs.m_thread);
+inline typename TimerWheel<Task>::Entry *
+PoolState<Task, Queue>::postExpired(typename TimerWheel<Task>::Entry *expired) {
+  using Entry = typename TimerWheel<Task>::Entry;
+
+  Entry *rejected = nullptr;
+  while (expired) {
+    Entry *entry = std::exchange(expired, expired->next);
+    // Entry rejected before is already marked as fired
+    uint32_t expected = detail::TimerEntryBase::kPending;
+    if (!entry->state.compare_exchange_strong(expected, detail::TimerEntryBase::kFired, std::memory_order_acq_rel) &&
+        expected == detail::TimerEntryBase::kCancelled) {
+      entry->unref();
+      continue;
+    }
+
+    bool posted = false;
+    for (size_t i = 0; i < std::max<size_t>(active_count.load(std::memory_order_relaxed), 1u) && !posted; ++i) {
+      posted = nextWorker().post(std::move(entry->task), entry->lane);
+    }
+    if (!posted) {
+      entry->next = rejected;
+      rejected = entry;
+      continue;
+    }
+    idle.notify();
+    checkHighWatermark(1);
+    entry->unref();
   }
-  return *this;
+  return rejected;
 }
 
+template <typename Task, template <typename> class Queue>
+inline Worker<Task, Queue>::Worker(size_t queue_size, size_t lane_count)
+    : m_queue_size(queue_size), m_lanes(lane_count), m_allocated(false), m_active(false), m_idle_since(0),
+      m_busy_since(0), m_rng_state(0), m_picks(0), m_aging_round(0), m_running_flag(true) {}
+
 template <typename Task, template <typename> class Queue> inline void Worker<Task, Queue>::stop() {
+  m_active.store(false, std::memory_order_relaxed);
   m_running_flag.store(false, std::memory_order_relaxed);
 }
 
-template <typename Task, template <typename> class Queue> inline void Worker<Task, Queue>::join() { m_thread.join(); }
+template <typename Task, template <typename> class Queue> inline void Worker<Task, Queue>::join() {
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+template <typename Task, template <typename> class Queue> inline bool Worker<Task, Queue>::isActive() const {
+  return m_active.load(std::memory_order_acquire);
+}
+
+template <typename Task, template <typename> class Queue> inline bool Worker<Task, Queue>::isAllocated() const {
+  return m_allocated.load(std::memory_order_acquire);
+}
+
+template <typename Task, template <typename> class Queue> inline uint64_t Worker<Task, Queue>::idleSince() const {
+  return m_idle_since.load(std::memory_order_relaxed);
+}
+
+template <typename Task, template <typename> class Queue> inline uint64_t Worker<Task, Queue>::busySince() const {
+  return m_busy_since.load(std::memory_order_relaxed);
+}
+
+template <typename Task, template <typename> class Queue>
+inline void Worker<Task, Queue>::start(size_t id, PoolState<Task, Queue> &state, std::vector<size_t> cpus) {
+  std::promise<void> ready;
+  auto allocated = ready.get_future();
+
+  m_running_flag.store(true, std::memory_order_relaxed);
+  m_rng_state = id + 1;
+  m_thread =
+      std::thread(&Worker<Task, Queue>::threadFunc, this, id, std::ref(state), std::move(cpus), std::move(ready));
+
+  try {
+    allocated.get();
+  } catch (...) {
+    m_thread.join();
+    throw;
+  }
+
+  m_active.store(true, std::memory_order_release);
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename Handler>
+inline bool Worker<Task, Queue>::post(Handler &&handler, size_t lane) {
+  using Pending = typename QueuedTask<Task>::template Pending<Handler>;
+
+  Lane &l = *m_lanes[lane];
+  const uint64_t now = detail::monotonicNs();
+  if ((isCurrentThread() && l.local.push(Pending{std::forward<Handler>(handler), now})) ||
+      l.inbox.push(Pending{std::forward<Handler>(handler), now})) {
+    m_counters.posted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+template <typename Task, template <typename> class Queue>
+template <typename It>
+inline size_t Worker<Task, Queue>::postBulk(It first, size_t count, size_t lane) {
+  using Pending = typename QueuedTask<Task>::template Pending<std::iter_value_t<It>>;
+  using PendingIterator = typename QueuedTask<Task>::template PendingIterator<It>;
+
+  Lane &l = *m_lanes[lane];
+  const uint64_t now = detail::monotonicNs();
+
+  size_t posted = 0;
+  if (isCurrentThread()) {
+    // Owner pushes to the deque don't need CAS anyway
+    while (posted < count && l.local.push(Pending{std::move(*first), now})) {
+      ++first;
+      ++posted;
+    }
+  }
+  if (posted < count) {
+    posted += l.inbox.pushN(PendingIterator{first, now}, count - posted);
+  }
+
+  m_counters.posted.fetch_add(posted, std::memory_order_relaxed);
+  return posted;
+}
 
 template <typename Task, template <typename> class Queue>
-inline void Worker<Task, Queue>::start(size_t id, std::condition_variable &cv) {
-  m_thread = std::thread(&Worker<Task, Queue>::threadFunc, this, id, std::ref(cv));
+inline bool Worker<Task, Queue>::steal(QueuedTask<Task> &task, size_t lane) {
+  if (!isAllocated()) {
+    return false;
+  }
+  Lane &l = *m_lanes[lane];
+  return l.local.steal(task) || l.inbox.pop(task);
+}
+
+template <typename Task, template <typename> class Queue> inline size_t Worker<Task, Queue>::size() const {
+  if (!isAllocated()) {
+    return 0;
+  }
+  size_t total = 0;
+  for (const auto &lane_ptr : m_lanes) {
+    total += lane_ptr->local.size() + lane_ptr->inbox.size();
+  }
+  return total;
+}
+
+template <typename Task, template <typename> class Queue> inline size_t Worker<Task, Queue>::capacity() const {
+  if (!isAllocated()) {
+    return 0;
+  }
+  size_t total = 0;
+  for (const auto &lane_ptr : m_lanes) {
+    total = detail::addCapacity(total, lane_ptr->inbox.capacity());
+  }
+  return total;
+}
+
+template <typename Task, template <typename> class Queue> inline WorkerCounters &Worker<Task, Queue>::counters() {
+  return m_counters;
+}
+
+template <typename Task, template <typename> class Queue> inline WorkerStats Worker<Task, Queue>::stats() const {
+  WorkerStats result;
+  result.posted = m_counters.posted.load(std::memory_order_relaxed);
+  result.rejected = m_counters.rejected.load(std::memory_order_relaxed);
+  result.stolen = m_counters.stolen.load(std::memory_order_relaxed);
+  result.executed = m_counters.executed.load(std::memory_order_relaxed);
+  result.occupancy = size();
+  result.active = isActive();
+  result.wait_time = m_counters.wait_time.snapshot();
+  result.run_time = m_counters.run_time.snapshot();
+  return result;
+}
+
+template <typename Task, template <typename> class Queue> inline bool Worker<Task, Queue>::isCurrentThread() const {
+  return *detail::thread_worker() == this;
 }
 
 template <typename Task, template <typename> class Queue>
@@ -114,24 +884,146 @@ inline size_t Worker<Task, Queue>::getWorkerIdForCurrentThread() {
   return *detail::thread_id();
 }
 
+template <typename Task, template <typename> class Queue> inline size_t Worker<Task, Queue>::nextRandom() {
+  // xorshift, quality is not important here
+  size_t x = m_rng_state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  m_rng_state = x;
+  return x;
+}
+
+template <typename Task, template <typename> class Queue>
+inline bool Worker<Task, Queue>::getTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state) {
+  const size_t lanes = m_lanes.size();
+
+  size_t first = 0;
+  if (lanes > 1 && m_picks % state.aging_interval == state.aging_interval - 1) {
+    first = 1 + m_aging_round % (lanes - 1);
+  }
+
+  for (size_t i = 0; i < lanes; ++i) {
+    if (getTask(task, state, (first + i) % lanes)) {
+      ++m_picks;
+      m_aging_round += first != 0;
+      state.checkLowWatermark();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+template <typename Task, template <typename> class Queue>
+inline bool Worker<Task, Queue>::getTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state, size_t lane) {
+  Lane &l = *m_lanes[lane];
+  if (l.local.pop(task) || l.inbox.pop(task)) {
+    return true;
+  }
+
+  const auto &siblings = state.workers;
+  const size_t count = siblings.size();
+  if (count < 2) {
+    return false;
+  }
+
+  const size_t first = nextRandom() % count;
+  for (size_t i = 0; i < count; ++i) {
+    Worker *donor = siblings[(first + i) % count].get();
+    if (donor != this && donor->steal(task, lane)) {
+      WorkerCounters::bump(m_counters.stolen);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+template <typename Task, template <typename> class Queue>
+inline bool Worker<Task, Queue>::waitTask(QueuedTask<Task> &task, PoolState<Task, Queue> &state) {
+  for (size_t i = 0; i < SPIN_COUNT; ++i) {
+    if (getTask(task, state)) {
+      return true;
+    }
+    cpuRelax();
+  }
+
+  while (m_running_flag.load(std::memory_order_relaxed)) {
+    const EventCount::Key key = state.idle.prepareWait();
+    if (getTask(task, state)) {
+      state.idle.cancelWait();
+      return true;
+    }
+    if (!m_running_flag.load(std::memory_order_relaxed)) {
+      state.idle.cancelWait();
+      break;
+    }
+    m_idle_since.store(detail::monotonicNs(), std::memory_order_relaxed);
+    state.idle.wait(key);
+    m_idle_since.store(0, std::memory_order_relaxed);
+
+    if (getTask(task, state)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 template <typename Task, template <typename> class Queue>
-inline void Worker<Task, Queue>::threadFunc(size_t id, std::condition_variable &cv) {
+inline void Worker<Task, Queue>::threadFunc(size_t id, PoolState<Task, Queue> &state, std::vector<size_t> cpus,
+                                            std::promise<void> ready) {
   *detail::thread_id() = id;
+  *detail::thread_worker() = this;
+
+  // Pinning is best effort, the pool works the same without it
+  if (!cpus.empty()) {
+    pinCurrentThread(cpus);
+  }
+
+  // Allocate queues from the pinned thread, first touch places them on its node
+  try {
+    if (!isAllocated()) {
+      for (auto &lane_ptr : m_lanes) {
+        lane_ptr.reset(new Lane(m_queue_size));
+      }
+      m_allocated.store(true, std::memory_order_release);
+    }
+    ready.set_value();
+  } catch (...) {
+    ready.set_exception(std::current_exception());
+    return;
+  }
+
+  state.started.wait(false, std::memory_order_acquire);
 
-  Task handler;
+  QueuedTask<Task> item;
 
   while (m_running_flag.load(std::memory_order_relaxed)) {
-    std::unique_lock lk(available_handler);
-    cv.wait(lk, [this, &handler] {
-      return this->m_queue->pop(handler) || !m_running_flag.load(std::memory_order_relaxed);
-    });
+    if (!getTask(item, state) && !waitTask(item, state)) {
+      break;
+    }
+
+    const uint64_t started = detail::monotonicNs();
+    const uint64_t waited = started - std::min(started, item.queued_at);
+    m_counters.wait_time.record(waited);
+    if (state.grow_threshold_ns != 0 && waited > state.grow_threshold_ns) {
+      state.grow_requested.store(true, std::memory_order_relaxed);
+    }
+
+    m_busy_since.store(started, std::memory_order_relaxed);
     try {
-      handler();
+      item.task();
     } catch (...) {
       // suppress all exceptions
     }
+    m_busy_since.store(0, std::memory_order_relaxed);
+
+    m_counters.run_time.record(detail::monotonicNs() - started);
+    WorkerCounters::bump(m_counters.executed);
   }
 }
 
 } // namespace tp
-} // namespace limb
\ No newline at end of file
+} // namespace limb
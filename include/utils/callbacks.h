@@ -2,11 +2,18 @@
 #define _CALLBACKS_H_
 #include <functional>
 
+#include "thread-pool/cancellation-token.hpp"
+
 namespace limb {
 
 using ProgressCallback = std::function<void(float currnetProgress)>;
 
 inline ProgressCallback defaultProgressCallback = [](float val) {};
 
+// Long running processing checks the token between steps and returns kCancelled once it trips
+using CancellationToken = tp::CancellationToken;
+
+inline const CancellationToken defaultCancellationToken{};
+
 } // namespace limb
 #endif // _CALLBACKS_H_
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef _PROGRESS_REPORTER_H_
+#define _PROGRESS_REPORTER_H_
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "utils/callbacks.h"
+
+namespace limb {
+
+// Throttles progress of a single request before it reaches the sink, processors report it after every tile.
+// Progress is passed on when it grew by at least minDelta and minInterval has passed since the last one passed on.
+// The first report (0% when reported before processing) and 100% are always passed on, 100% only once.
+// Reports of a request are sequential, but they may come from different threads, so the class has no locking.
+class ProgressReporter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  ProgressReporter(ProgressCallback sink, Clock::duration minInterval, float minDelta)
+      : m_sink(std::move(sink)), m_minInterval(minInterval), m_minDelta(minDelta) {}
+
+  void report(float progress) {
+    progress = std::clamp(progress, 0.0f, 1.0f);
+    if (m_finished) {
+      return;
+    }
+
+    const Clock::time_point now = Clock::now();
+    const bool last = progress >= 1.0f;
+    if (m_reported && !last &&
+        (progress <= m_lastProgress || progress - m_lastProgress < m_minDelta || now - m_lastTime < m_minInterval)) {
+      return;
+    }
+
+    m_reported = true;
+    m_finished = last;
+    m_lastProgress = progress;
+    m_lastTime = now;
+    m_sink(progress);
+  }
+
+  // Reports 100% unless it was reported already, called when processing succeeds.
+  void finish() { report(1.0f); }
+
+  // Callback for the processor, the reporter must outlive it.
+  ProgressCallback callback() {
+    return [this](float progress) { report(progress); };
+  }
+
+private:
+  ProgressCallback m_sink;
+  const Clock::duration m_minInterval;
+  const float m_minDelta;
+
+  bool m_reported = false;
+  bool m_finished = false;
+  float m_lastProgress = 0.0f;
+  Clock::time_point m_lastTime;
+};
+
+} // namespace limb
+#endif // _PROGRESS_REPORTER_H_
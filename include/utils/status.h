@@ -2,14 +2,18 @@
 #define _STATUS_H_
 
 static const char *ReturnStatusResolver[]{
-    "Ok",             // 0
-    "Unknown error",  // 1
-    "Not Found",      // 2
-    "Already Exists", // 3
-    "Aborted",        // 4
-    "Unimplemented",  // 5
-    "Uninitialized",  // 6
-    "Invalid input"   // 7
+    "Ok",               // 0
+    "Unknown error",    // 1
+    "Not Found",        // 2
+    "Already Exists",   // 3
+    "Aborted",          // 4
+    "Unimplemented",    // 5
+    "Uninitialized",    // 6
+    "Invalid input",    // 7
+    "Incomplete",       // 8
+    "Buffer too small", // 9
+    "Out of memory",    // 10
+    "Cancelled"         // 11
 };
 
 namespace limb {
@@ -25,6 +29,7 @@ enum class ReturnStatus : int {
   kIncomplete = 8,
   kBufferTooSmall = 9,
   kOutOfMemory = 10,
+  kCancelled = 11,
 };
 
 class StatusManager {
@@ -18,7 +18,10 @@ LoopbackProcessor::LoopbackProcessor() {};
 LoopbackProcessor::~LoopbackProcessor() {};
 
 liret LoopbackProcessor::process_image(const ImageInfo &inimage, ImageInfo &outimage,
-                                       const ProgressCallback &procb) const {
+                                       const ProgressCallback &procb, const CancellationToken &token) const {
+  if (token.isCancelled()) {
+    return liret::kCancelled;
+  }
   procb(0.0f); // report processing is started
   // Simple copy from input to output
   outimage.w = inimage.w;
@@ -28,7 +28,8 @@ public:
   std::string_view name() const override { return g_processorName; };
 
   liret process_image(const ImageInfo &inimage, ImageInfo &outimage,
-                      const ProgressCallback &procb = defaultProgressCallback) const override;
+                      const ProgressCallback &procb = defaultProgressCallback,
+                      const CancellationToken &token = defaultCancellationToken) const override;
 };
 
 class LoopbackContainer : public ProcessorContainer {
@@ -247,7 +247,7 @@ RealesrganProcessor::~RealesrganProcessor() {
 }
 
 liret RealesrganProcessor::process_image(const ImageInfo &inimage, ImageInfo &outimage,
-                                         const ProgressCallback &procb) const {
+                                         const ProgressCallback &procb, const CancellationToken &token) const {
   // TODO: check does inmat is really nessesary
   ncnn::Mat inmat(inimage.w, inimage.h, (void *)inimage.data, (size_t)inimage.c, inimage.c);
 
@@ -282,6 +282,8 @@ liret RealesrganProcessor::process_image(const ImageInfo &inimage, ImageInfo &ou
 
   // Inform Progress callback about start
   procb(0.0);
+  // Checked before every tile, so a cancelled request holds the device for at most one more tile
+  bool cancelled = false;
   for (int yi = 0; yi < ytiles; yi++) {
     const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
 
@@ -335,6 +337,10 @@ liret RealesrganProcessor::process_image(const ImageInfo &inimage, ImageInfo &ou
     }
 
     for (int xi = 0; xi < xtiles; xi++) {
+      if (token.isCancelled()) {
+        cancelled = true;
+        break;
+      }
       const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
       if (tta_mode) {
         // preproc
@@ -572,6 +578,9 @@ liret RealesrganProcessor::process_image(const ImageInfo &inimage, ImageInfo &ou
       // TODO: link to log system
       procb((float)(yi * xtiles + (xi + 1)) / (ytiles * xtiles));
     }
+    if (cancelled) {
+      break;
+    }
     // download
     {
       ncnn::Mat out;
@@ -610,6 +619,12 @@ liret RealesrganProcessor::process_image(const ImageInfo &inimage, ImageInfo &ou
   }
   net->vulkan_device()->reclaim_blob_allocator(blob_vkallocator);
   net->vulkan_device()->reclaim_staging_allocator(staging_vkallocator);
+
+  if (cancelled) {
+    delete[] outimage.data;
+    outimage.data = nullptr;
+    return liret::kCancelled;
+  }
   return liret::kOk;
 }
 
@@ -150,8 +150,13 @@ RmbgProcessor::~RmbgProcessor() {
   }
 };
 
-liret RmbgProcessor::process_image(const ImageInfo &inimage, ImageInfo &outimage, const ProgressCallback &procb) const {
+liret RmbgProcessor::process_image(const ImageInfo &inimage, ImageInfo &outimage, const ProgressCallback &procb,
+                                   const CancellationToken &token) const {
   outimage.data = nullptr;
+  if (token.isCancelled()) {
+    return liret::kCancelled;
+  }
+
   outimage.w = inimage.w;
   outimage.h = inimage.h;
   outimage.c = 4; // Always output RGBA
@@ -220,6 +225,10 @@ liret RmbgProcessor::process_image(const ImageInfo &inimage, ImageInfo &outimage
     return liret::kAborted;
   }
 
+  if (token.isCancelled()) {
+    return liret::kCancelled;
+  }
+
   ncnn::Mat mask(pImage.w, pImage.h, outputTensor.GetTensorMutableData<float>(), 4, 1);
 
   ncnn::VkCompute cmd(vulkanDevice);
@@ -36,6 +36,10 @@ void tryDefaultsAmqpTransport(limb::AmqpConfig &conf) {
   if (conf.prefetchCount == 0) {
     conf.prefetchCount = 20;
   }
+
+  if (conf.drainTimeout == 0) {
+    conf.drainTimeout = 30;
+  }
 }
 
 liret tryFillAmqpTransport(const simdjson::dom::element &transport, limb::AmqpConfig &conf) {
@@ -68,6 +72,76 @@ liret tryFillAmqpTransport(const simdjson::dom::element &transport, limb::AmqpCo
   }
   conf.port = uint16_t(parsed_uint.value());
 
+  // Optional, defaults are filled in before
+  if (transport["drainTimeout"].error() == simdjson::SUCCESS) {
+    parsed_uint = transport["drainTimeout"].get_uint64();
+    if (parsed_uint.error() || parsed_uint.value() > std::numeric_limits<uint16_t>::max()) {
+      return liret::kIncomplete;
+    }
+    conf.drainTimeout = uint16_t(parsed_uint.value());
+  }
+
+  if (transport["sharedProcessImageQueue"].error() == simdjson::SUCCESS) {
+    auto parsed_bool = transport["sharedProcessImageQueue"].get_bool();
+    if (parsed_bool.error()) {
+      return liret::kIncomplete;
+    }
+    conf.sharedProcessImageQueue = parsed_bool.value();
+  }
+
+  if (transport["processorQueues"].error() == simdjson::SUCCESS) {
+    auto queues = transport["processorQueues"].get_array();
+    if (queues.error()) {
+      return liret::kIncomplete;
+    }
+    for (auto queue : queues.value()) {
+      limb::ProcessorQueueConfig queueConf;
+      parsed = queue["processor"].get_string();
+      if (parsed.error()) {
+        return liret::kIncomplete;
+      }
+      queueConf.processor.assign(parsed.value());
+
+      for (auto [key, field] : {std::pair{"prefetchCount", &queueConf.prefetchCount},
+                                std::pair{"concurrency", &queueConf.concurrency}}) {
+        if (queue[key].error() == simdjson::SUCCESS) {
+          parsed_uint = queue[key].get_uint64();
+          if (parsed_uint.error() || parsed_uint.value() > std::numeric_limits<uint16_t>::max()) {
+            return liret::kIncomplete;
+          }
+          *field = uint16_t(parsed_uint.value());
+        }
+      }
+      conf.processorQueues.push_back(std::move(queueConf));
+    }
+  }
+
+  return liret::kOk;
+}
+
+liret tryFillWorkerPool(const simdjson::dom::element &workers, limb::WorkerPoolConfig &conf) {
+  if (workers["placement"].error() == simdjson::SUCCESS) {
+    auto parsed = workers["placement"].get_string();
+    if (parsed.error() || (parsed.value() != "none" && parsed.value() != "compact" && parsed.value() != "spread")) {
+      return liret::kIncomplete;
+    }
+    conf.placement.assign(parsed.value());
+  }
+
+  if (workers["cpus"].error() == simdjson::SUCCESS) {
+    auto parsed = workers["cpus"].get_array();
+    if (parsed.error()) {
+      return liret::kIncomplete;
+    }
+    for (auto cpu : parsed.value()) {
+      auto parsed_uint = cpu.get_uint64();
+      if (parsed_uint.error() || parsed_uint.value() > std::numeric_limits<uint32_t>::max()) {
+        return liret::kIncomplete;
+      }
+      conf.cpus.push_back(uint32_t(parsed_uint.value()));
+    }
+  }
+
   return liret::kOk;
 }
 
@@ -94,6 +168,14 @@ liret parseDocument(const simdjson::dom::element &doc, limb::AppConfig &conf) {
   } else {
     ret = liret::kIncomplete;
   }
+  if (ret != liret::kOk) {
+    return ret;
+  }
+
+  // Optional, workers are not pinned by default
+  if (app["workers"].error() == simdjson::SUCCESS) {
+    ret = tryFillWorkerPool(app["workers"], conf.workerConfig);
+  }
 
   return ret;
 }
@@ -2,6 +2,8 @@
 
 namespace limb {
 
+static_assert(PARSE_PADDING >= simdjson::SIMDJSON_PADDING, "Padded data is too short for simdjson");
+
 liret JsonTaskParser::parse(const uint8_t *data, size_t size, ImageTask &task) {
   if (data == nullptr || size == 0) {
     return liret::kInvalidInput;
@@ -11,12 +13,30 @@ liret JsonTaskParser::parse(const uint8_t *data, size_t size, ImageTask &task) {
 
   std::lock_guard<std::mutex> lock(m_parserMutex);
   const simdjson::dom::element doc = m_parser.parse(paddedData);
+  return fromDocument(doc, task);
+}
 
-  auto parsed_uint = doc["modelId"].get_uint64();
-  if (parsed_uint.error() || parsed_uint.value() > std::numeric_limits<uint32_t>::max()) {
+liret JsonTaskParser::parsePadded(const uint8_t *data, size_t size, ImageTask &task) {
+  if (data == nullptr || size == 0) {
     return liret::kInvalidInput;
   }
-  task.modelId = uint32_t(parsed_uint.value());
+
+  std::lock_guard<std::mutex> lock(m_parserMutex);
+  // Padding is there already, so simdjson reads the buffer without copying it
+  const simdjson::dom::element doc = m_parser.parse(data, size, false);
+  return fromDocument(doc, task);
+}
+
+liret JsonTaskParser::fromDocument(const simdjson::dom::element &doc, ImageTask &task) {
+  // Model indices are local to the node, requests routed by processor name leave it out
+  task.modelId = ImageTask::NO_MODEL;
+  if (doc["modelId"].error() != simdjson::NO_SUCH_FIELD) {
+    auto parsed_uint = doc["modelId"].get_uint64();
+    if (parsed_uint.error() || parsed_uint.value() >= ImageTask::NO_MODEL) {
+      return liret::kInvalidInput;
+    }
+    task.modelId = uint32_t(parsed_uint.value());
+  }
 
   auto parsed = doc["imageId"].get_string();
   if (parsed.error()) {
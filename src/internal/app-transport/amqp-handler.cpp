@@ -1,16 +1,180 @@
 #include "app-transport/amqp-handler.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <future>
 #include <mutex>
-#include <thread>
 
 #include "abnet/abnet.hpp"
 
-#define CONNECTION_TIMEOUT 5000   // 5 seconds
-#define HEARTBEAT_RESOLUTION 1000 // 1 second
-#define DEFAULT_HEARTBEAT 10      // 10 seconds
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <vector>
+
+// Edge-triggered epoll reactor, other platforms poll the socket
+#define LIMB_AMQP_REACTOR 1
+#endif
+
+#define CONNECTION_TIMEOUT 5000 // 5 seconds
+#define DEFAULT_HEARTBEAT 10    // 10 seconds
+
+using HeartbeatClock = std::chrono::high_resolution_clock;
+
+#if defined(LIMB_AMQP_REACTOR)
+// Ring buffer mapped twice back to back, so both the readable and the writable regions are contiguous.
+// The socket is read straight into it and AMQP-CPP parses frames in place, even those which wrap around.
+class MirroredRing {
+public:
+  explicit MirroredRing(size_t size) {
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size = (size + page - 1) / page * page;
+
+    const int fd = memfd_create("amqp-input", MFD_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    void *reserved = MAP_FAILED;
+    if (ftruncate(fd, off_t(size)) == 0) {
+      reserved = mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (reserved != MAP_FAILED) {
+      char *base = static_cast<char *>(reserved);
+      if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+          mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+        m_data = base;
+        m_size = size;
+      } else {
+        munmap(reserved, size * 2);
+      }
+    }
+    close(fd);
+  }
+
+  ~MirroredRing() {
+    if (m_data) {
+      munmap(m_data, m_size * 2);
+    }
+  }
+
+  bool valid() const { return m_data != nullptr; }
+
+  const char *readPtr() const { return m_data + m_head; }
+  size_t readable() const { return m_tail - m_head; }
+
+  char *writePtr() { return m_data + m_tail; }
+  size_t writable() const { return m_size - readable(); }
+
+  void produce(size_t count) { m_tail += count; }
+
+  void consume(size_t count) {
+    m_head += count;
+    if (m_head >= m_size) {
+      m_head -= m_size;
+      m_tail -= m_size;
+    }
+  }
+
+private:
+  MirroredRing(const MirroredRing &) = delete;
+  MirroredRing &operator=(const MirroredRing &) = delete;
+
+  char *m_data = nullptr;
+  size_t m_size = 0;
+  // Offsets of the first unparsed and the first free byte, head stays in the first mapping
+  size_t m_head = 0;
+  size_t m_tail = 0;
+};
+
+// Outbound frames in the order AMQP-CPP produced them. Small frames are coalesced into the last buffer,
+// so a burst of acks or publishes is sent by a single sendmsg instead of one syscall per frame.
+class FrameQueue {
+public:
+  static constexpr size_t COALESCE_LIMIT = 16 * 1024;
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  // Spare buffers kept for reuse, so steady traffic does not allocate
+  static constexpr size_t SPARE_COUNT = 16;
+
+  bool empty() const { return m_frames.empty(); }
+
+  void append(const char *data, size_t size) {
+    const bool small = size <= COALESCE_LIMIT;
+    // Only chunks are coalesced into, large frames have buffers of their own size
+    if (small && !m_frames.empty() && m_frames.back().capacity() == CHUNK_SIZE &&
+        m_frames.back().size() + size <= CHUNK_SIZE) {
+      m_frames.back().insert(m_frames.back().end(), data, data + size);
+      return;
+    }
+
+    std::vector<char> frame;
+    if (small && !m_spare.empty()) {
+      frame = std::move(m_spare.back());
+      m_spare.pop_back();
+    } else {
+      frame.reserve(small ? CHUNK_SIZE : size);
+    }
+    frame.assign(data, data + size);
+    m_frames.push_back(std::move(frame));
+  }
+
+  // Moves frames of other to the end of this queue and hands it the spare buffers
+  void takeFrom(FrameQueue &other) {
+    for (std::vector<char> &frame : other.m_frames) {
+      m_frames.push_back(std::move(frame));
+    }
+    other.m_frames.clear();
+    while (!m_spare.empty() && other.m_spare.size() < SPARE_COUNT) {
+      other.m_spare.push_back(std::move(m_spare.back()));
+      m_spare.pop_back();
+    }
+  }
+
+  // Fills iov with unsent data, returns number of entries used
+  size_t gather(iovec *iov, size_t count) const {
+    size_t used = 0;
+    size_t offset = m_offset;
+    for (auto it = m_frames.begin(); it != m_frames.end() && used < count; ++it, offset = 0) {
+      iov[used].iov_base = const_cast<char *>(it->data() + offset);
+      iov[used].iov_len = it->size() - offset;
+      used++;
+    }
+    return used;
+  }
+
+  void consume(size_t count) {
+    while (count != 0) {
+      std::vector<char> &front = m_frames.front();
+      const size_t left = front.size() - m_offset;
+      if (count < left) {
+        m_offset += count;
+        return;
+      }
+      count -= left;
+      m_offset = 0;
+      if (front.capacity() == CHUNK_SIZE && m_spare.size() < SPARE_COUNT) {
+        front.clear();
+        m_spare.push_back(std::move(front));
+      }
+      m_frames.pop_front();
+    }
+  }
+
+private:
+  std::deque<std::vector<char>> m_frames;
+  // Bytes of the front frame already sent
+  size_t m_offset = 0;
+  std::vector<std::vector<char>> m_spare;
+};
+#else
 class Buffer {
 public:
   explicit Buffer(size_t size) : m_data(size, 0), m_use(0) {}
@@ -44,11 +208,15 @@ private:
   std::vector<char> m_data;
   size_t m_use;
 };
+#endif
 
 struct AmqpHandlerImpl {
   AmqpHandlerImpl(const limb::AmqpConfig *_conf = nullptr)
-      : inputBuffer(AmqpHandler::BUFFER_SIZE), outBuffer(AmqpHandler::BUFFER_SIZE), sock(abnet::invalid_socket),
-        connection(nullptr), tmpBuff(AmqpHandler::TEMP_BUFFER_SIZE), conf(_conf), quit(false), keepAlive(true) {
+      : inputBuffer(AmqpHandler::BUFFER_SIZE),
+#if !defined(LIMB_AMQP_REACTOR)
+        outBuffer(AmqpHandler::BUFFER_SIZE), tmpBuff(AmqpHandler::TEMP_BUFFER_SIZE),
+#endif
+        sock(abnet::invalid_socket), connection(nullptr), conf(_conf), quit(false), keepAlive(true) {
 
     if (conf == nullptr) {
       static const limb::AmqpConfig defaultConf{.heartbeat = 60};
@@ -56,28 +224,201 @@ struct AmqpHandlerImpl {
     }
   }
 
+#if defined(LIMB_AMQP_REACTOR)
+  ~AmqpHandlerImpl() {
+    for (int fd : {epollFd, wakeFd, timerFd}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  MirroredRing inputBuffer;
+  // Appended by onData on any thread under writeMtx, taken over by the loop thread
+  FrameQueue outPending;
+  // Owned by the loop thread
+  FrameQueue outSending;
+  // Set while a wakeup is written to wakeFd and not yet consumed
+  std::atomic<bool> wakePending{false};
+
+  int epollFd = -1;
+  int wakeFd = -1;
+  int timerFd = -1;
+#else
   Buffer inputBuffer;
   Buffer outBuffer;
+  // Time the loop checks the heartbeat at
+  HeartbeatClock::time_point heartbeatDue;
+#endif
   abnet::socket_type sock;
   AMQP::Connection *connection;
+#if !defined(LIMB_AMQP_REACTOR)
   std::vector<char> tmpBuff;
+#endif
 
   const limb::AmqpConfig *conf;
 
   std::atomic<bool> quit;
-  std::atomic<std::chrono::high_resolution_clock::time_point> lastMessage;
+  std::atomic<HeartbeatClock::time_point> lastMessage;
   // for socket send
   std::mutex sendMtx;
   // for buffer write
   std::mutex writeMtx;
-  // for cleaunp
-  std::vector<std::future<void>> heartbeaters;
+  std::function<void()> loopHandler;
+  // Negotiated by the loop thread, which sends heartbeats itself
+  uint16_t heartbeatInterval = 0;
 
   int keepAlive = true;
   int reuseAddr = true;
   bool connected = false;
 };
 
+namespace {
+// Sends heartbeat if nothing was sent for interval, returns time until the next check
+HeartbeatClock::duration checkHeartbeat(AmqpHandlerImpl &impl, AMQP::Connection *connection, uint16_t interval) {
+  const HeartbeatClock::duration period = std::chrono::seconds(interval);
+  const HeartbeatClock::duration idle = HeartbeatClock::now() - impl.lastMessage.load();
+  // If less than <interval> seconds have passed since the last message, then we skip
+  if (idle < period) {
+    return period - idle;
+  }
+  connection->heartbeat();
+  return period;
+}
+
+#if !defined(LIMB_AMQP_REACTOR)
+// Milliseconds the loop may wait for input. The wait cannot be interrupted, so it is kept short for the loop handler
+// to run soon after wake, and it ends in time for the heartbeat check.
+int pollTimeout(const AmqpHandlerImpl &impl) {
+  constexpr int maxWait = 2;
+  if (impl.heartbeatInterval == 0) {
+    return maxWait;
+  }
+  const auto wait = std::chrono::ceil<std::chrono::milliseconds>(impl.heartbeatDue - HeartbeatClock::now());
+  return int(std::clamp<std::chrono::milliseconds::rep>(wait.count(), 0, maxWait));
+}
+#endif
+
+#if defined(LIMB_AMQP_REACTOR)
+bool setupReactor(AmqpHandlerImpl &impl) {
+  if (!impl.inputBuffer.valid()) {
+    printf("Reactor error: failed to map input buffer\n");
+    return false;
+  }
+
+  const int flags = fcntl(impl.sock, F_GETFL, 0);
+  if (flags < 0 || fcntl(impl.sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+    printf("Reactor error: %s\n", strerror(errno));
+    return false;
+  }
+
+  impl.epollFd = epoll_create1(EPOLL_CLOEXEC);
+  impl.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  impl.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (impl.epollFd < 0 || impl.wakeFd < 0 || impl.timerFd < 0) {
+    printf("Reactor error: %s\n", strerror(errno));
+    return false;
+  }
+
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.fd = impl.sock;
+  if (epoll_ctl(impl.epollFd, EPOLL_CTL_ADD, impl.sock, &event) < 0) {
+    printf("Reactor error: %s\n", strerror(errno));
+    return false;
+  }
+  for (int fd : {impl.wakeFd, impl.timerFd}) {
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(impl.epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      printf("Reactor error: %s\n", strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+void wakeReactor(AmqpHandlerImpl &impl) {
+  if (impl.wakeFd >= 0 && !impl.wakePending.exchange(true)) {
+    const uint64_t one = 1;
+    (void)!write(impl.wakeFd, &one, sizeof(one));
+  }
+}
+
+void armHeartbeat(AmqpHandlerImpl &impl, HeartbeatClock::duration delay) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+  itimerspec spec{};
+  // Zero would disarm the timer
+  spec.it_value.tv_sec = time_t(ns / 1000000000);
+  spec.it_value.tv_nsec = long(ns % 1000000000) + (ns <= 0 ? 1 : 0);
+  timerfd_settime(impl.timerFd, 0, &spec, nullptr);
+}
+
+// Reads until the socket is drained, edge-triggered readiness is reported once
+bool readSocket(AmqpHandlerImpl &impl) {
+  for (;;) {
+    if (impl.inputBuffer.writable() == 0) {
+      printf("Recv error: frame exceeds input buffer\n");
+      return false;
+    }
+
+    const ssize_t bytesRead = recv(impl.sock, impl.inputBuffer.writePtr(), impl.inputBuffer.writable(), 0);
+    if (bytesRead == 0) {
+      printf("Recv error: connection closed by peer\n");
+      return false;
+    }
+    if (bytesRead < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      printf("Recv error: %s\n", strerror(errno));
+      return false;
+    }
+
+    impl.inputBuffer.produce(size_t(bytesRead));
+    if (impl.connection) {
+      impl.inputBuffer.consume(impl.connection->parse(impl.inputBuffer.readPtr(), impl.inputBuffer.readable()));
+    }
+  }
+}
+
+// Sends pending output until it is all sent or the socket is full, EPOLLOUT resumes it then
+bool flushOutput(AmqpHandlerImpl &impl) {
+  iovec iov[64];
+  for (;;) {
+    if (impl.outSending.empty()) {
+      std::lock_guard<std::mutex> guard(impl.writeMtx);
+      impl.outSending.takeFrom(impl.outPending);
+    }
+    if (impl.outSending.empty()) {
+      return true;
+    }
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = impl.outSending.gather(iov, sizeof(iov) / sizeof(iov[0]));
+    const ssize_t sent = sendmsg(impl.sock, &msg, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      printf("Error send: %s\n", strerror(errno));
+      return false;
+    }
+    // mesure time for heartbeat
+    impl.lastMessage.store(HeartbeatClock::now());
+    impl.outSending.consume(size_t(sent));
+  }
+}
+#endif
+} // namespace
+
 AmqpHandler::AmqpHandler(const char *host, uint16_t port, const limb::AmqpConfig *conf)
     : m_impl(new AmqpHandlerImpl(conf)) {
   abnet::error_code ec;
@@ -114,6 +455,12 @@ AmqpHandler::AmqpHandler(const char *host, uint16_t port, const limb::AmqpConfig
       break;
     }
 
+#if defined(LIMB_AMQP_REACTOR)
+    if (!setupReactor(*m_impl)) {
+      break;
+    }
+#endif
+
     return;
   } while (0);
   if (m_impl->sock != abnet::invalid_socket) {
@@ -122,16 +469,74 @@ AmqpHandler::AmqpHandler(const char *host, uint16_t port, const limb::AmqpConfig
   m_impl->sock = abnet::invalid_socket;
 }
 
+#if defined(LIMB_AMQP_REACTOR)
+void AmqpHandler::loop() {
+  if (m_impl->sock == abnet::invalid_socket) {
+    printf("Network loop has no connection!\n");
+    return;
+  }
+
+  // Protocol header is queued by the connection constructor
+  bool broken = !flushOutput(*m_impl);
+  epoll_event events[4];
+  while (!m_impl->quit && !broken) {
+    const int count = epoll_wait(m_impl->epollFd, events, 4, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("Epoll error: %s\n", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < count && !broken; i++) {
+      const int fd = events[i].data.fd;
+      if (fd == m_impl->sock) {
+        // Hang up is noticed by recv, EPOLLOUT is handled by the flush below
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+          broken = !readSocket(*m_impl);
+        }
+      } else if (fd == m_impl->wakeFd) {
+        uint64_t value;
+        m_impl->wakePending = false;
+        (void)!read(m_impl->wakeFd, &value, sizeof(value));
+      } else if (fd == m_impl->timerFd) {
+        uint64_t expirations;
+        (void)!read(m_impl->timerFd, &expirations, sizeof(expirations));
+        if (m_impl->connection && m_impl->heartbeatInterval != 0) {
+          armHeartbeat(*m_impl, checkHeartbeat(*m_impl, m_impl->connection, m_impl->heartbeatInterval));
+        }
+      }
+    }
+
+    if (m_impl->loopHandler) {
+      m_impl->loopHandler();
+    }
+    broken = !flushOutput(*m_impl) || broken;
+  }
+
+  if (m_impl->quit == 0) {
+    printf("Network loop force quit!\n");
+  }
+  if (m_impl->quit && !broken) {
+    // Work queued between the last iteration and quit
+    if (m_impl->loopHandler) {
+      m_impl->loopHandler();
+    }
+    flushOutput(*m_impl);
+  }
+}
+#else
 void AmqpHandler::loop() {
   abnet::error_code ec;
 
   while (!m_impl->quit) {
-    int poll_res = abnet::socket_ops::poll_read(m_impl->sock, 0, 10000, ec);
+    int poll_res = abnet::socket_ops::poll_read(m_impl->sock, 0, pollTimeout(*m_impl), ec);
     if (poll_res == abnet::socket_error_retval) {
       abnet::socket_ops::get_last_error(ec, 0);
       printf("Select error: %s\n", ec.message().c_str());
       break;
-    } else {
+    } else if (poll_res > 0) {
       // Check if data is available for reading
       size_t bytesAvailable = m_impl->tmpBuff.size();
 
@@ -157,57 +562,52 @@ void AmqpHandler::loop() {
         m_impl->inputBuffer.shl(count);
       }
     }
+    if (m_impl->connection && m_impl->heartbeatInterval != 0 && HeartbeatClock::now() >= m_impl->heartbeatDue) {
+      m_impl->heartbeatDue =
+          HeartbeatClock::now() + checkHeartbeat(*m_impl, m_impl->connection, m_impl->heartbeatInterval);
+    }
+    if (m_impl->loopHandler) {
+      m_impl->loopHandler();
+    }
     sendDataFromBuffer();
   }
 
   if (m_impl->quit == 0) {
     printf("Network loop force quit!\n");
   }
+  if (m_impl->quit && m_impl->loopHandler) {
+    m_impl->loopHandler();
+  }
   if (m_impl->quit && m_impl->outBuffer.available()) {
     sendDataFromBuffer();
   }
 }
+#endif
 
 AmqpHandler::~AmqpHandler() {
+  quit();
   close_handler();
-  for (int i = 0; i < m_impl->heartbeaters.size(); i++) {
-    m_impl->heartbeaters[i].wait();
-  }
   delete m_impl;
 }
-void AmqpHandler::quit() { m_impl->quit = true; }
-
-void AmqpHandler::AmqpHandler::close_handler() {
-  abnet::error_code ec;
-  abnet::socket_ops::close(m_impl->sock, 0, 0, ec);
+void AmqpHandler::quit() {
+  m_impl->quit = true;
+#if defined(LIMB_AMQP_REACTOR)
+  wakeReactor(*m_impl);
+#endif
 }
 
-// Should run async
-void AmqpHandler::heartbeater(AMQP::Connection *connection, uint16_t interval) {
-  using clock = std::chrono::high_resolution_clock;
+void AmqpHandler::setLoopHandler(std::function<void()> handler) { m_impl->loopHandler = std::move(handler); }
 
-  clock::time_point lastSent = clock::now();
-  while (m_impl->quit == false) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(HEARTBEAT_RESOLUTION));
-    if (connection == nullptr) {
-      return;
-    }
-    auto currentTime = clock::now();
-    std::chrono::duration<float> diff = currentTime - lastSent;
-    // if time is up, then try to send heartbeat
-    if (uint16_t(diff.count()) >= interval) {
-      auto const lastMessage = m_impl->lastMessage.load();
-      std::chrono::duration<float> writeDiff = currentTime - lastMessage;
+void AmqpHandler::wake() {
+#if defined(LIMB_AMQP_REACTOR)
+  wakeReactor(*m_impl);
+#endif
+  // Poll loop waits for at most a couple of milliseconds, the loop handler runs after the wait anyway
+}
 
-      // If less than <interval> seconds have passed since the last message, then we skip
-      if (uint16_t(writeDiff.count()) < interval) {
-        lastSent = lastMessage;
-      } else {
-        lastSent = currentTime;
-        connection->heartbeat();
-      }
-    }
-  }
+void AmqpHandler::AmqpHandler::close_handler() {
+  abnet::error_code ec;
+  abnet::socket_ops::close(m_impl->sock, 0, 0, ec);
 }
 
 uint16_t AmqpHandler::onNegotiate(AMQP::Connection *connection, uint16_t interval) {
@@ -217,19 +617,40 @@ uint16_t AmqpHandler::onNegotiate(AMQP::Connection *connection, uint16_t interva
   }
   interval = interval < m_impl->conf->heartbeat ? interval : m_impl->conf->heartbeat;
   interval = interval < DEFAULT_HEARTBEAT ? DEFAULT_HEARTBEAT : interval;
-  m_impl->heartbeaters.emplace_back(std::async(&AmqpHandler::heartbeater, this, connection, interval));
+
+  // Negotiation runs on the loop thread, which sends heartbeats itself
+  m_impl->heartbeatInterval = interval;
+#if defined(LIMB_AMQP_REACTOR)
+  armHeartbeat(*m_impl, std::chrono::seconds(interval));
+#else
+  m_impl->heartbeatDue = HeartbeatClock::now() + std::chrono::seconds(interval);
+#endif
   return interval;
 }
 
+#if defined(LIMB_AMQP_REACTOR)
+void AmqpHandler::onData(AMQP::Connection *connection, const char *data, size_t size) {
+  {
+    std::lock_guard<std::mutex> guard(m_impl->writeMtx);
+    m_impl->connection = connection;
+    m_impl->outPending.append(data, size);
+  }
+  // Coalesced by wakePending, output of the loop thread itself is flushed by the same iteration
+  wakeReactor(*m_impl);
+}
+#else
 void AmqpHandler::onData(AMQP::Connection *connection, const char *data, size_t size) {
   std::lock_guard<std::mutex> guard(m_impl->writeMtx);
   m_impl->connection = connection;
-  const size_t writen = m_impl->outBuffer.write(data, size);
-  if (writen == size) {
+  // Frame larger than the free space is written in parts, sending the full buffer in between
+  size_t writen = m_impl->outBuffer.write(data, size);
+  while (writen != size) {
     sendDataFromBuffer();
-    m_impl->outBuffer.write(data + writen, size - writen);
+    writen += m_impl->outBuffer.write(data + writen, size - writen);
   }
+  sendDataFromBuffer();
 }
+#endif
 
 void AmqpHandler::onReady(AMQP::Connection *connection) { m_impl->connected = true; }
 
@@ -244,11 +665,12 @@ void AmqpHandler::onClosed(AMQP::Connection *connection) {
 bool AmqpHandler::connected() const { return m_impl->connected; }
 
 void AmqpHandler::sendDataFromBuffer() {
+#if !defined(LIMB_AMQP_REACTOR)
   std::lock_guard<std::mutex> guard(m_impl->sendMtx);
   if (m_impl->outBuffer.available()) {
     // mesure time for heartbeat, in this case its not nessesary to be atomic
     // but read can be in critial sections
-    m_impl->lastMessage.store(std::chrono::high_resolution_clock::now());
+    m_impl->lastMessage.store(HeartbeatClock::now());
     abnet::error_code ec;
     abnet::socket_ops::send1(m_impl->sock, m_impl->outBuffer.data(), m_impl->outBuffer.available(), 0, ec);
     if (ec.value() != 0) {
@@ -256,4 +678,5 @@ void AmqpHandler::sendDataFromBuffer() {
     }
     m_impl->outBuffer.drain();
   }
-}
\ No newline at end of file
+#endif
+}
@@ -3,28 +3,113 @@
 #include "image-service/image-service.hpp"
 
 #include "app-tasks/task-parser.hpp"
+#include "utils/progress-reporter.h"
 
-#include <format>
-#include <future>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 
 namespace {
 constexpr auto g_pingQueue = "Ping";
 constexpr auto g_getAppInfo = "GetAppInfo";
+// Shared by all processors, processor queues are named ProcessImage.<processor>
 constexpr auto g_processImageQueue = "ProcessImage";
+// Correlation id of the message tells which ProcessImage request to cancel
+constexpr auto g_cancelProcessImageQueue = "CancelProcessImage";
+
+// How long drain waits for deliveries cancelled at its deadline, they stop at the next tile
+constexpr auto g_drainCancelGrace = std::chrono::seconds(5);
+
+static_assert(limb::MessageBody::PADDING >= limb::PARSE_PADDING, "Message body is too short for parsing in place");
+
+// ProcessImage deliveries a worker is given at once, one runs inference while the next is fetched and decoded
+constexpr size_t g_deliveriesPerWorker = 2;
+// How often the ProcessImage prefetch is recomputed
+constexpr auto g_prefetchInterval = std::chrono::seconds(1);
+
+// Segment length of the channel command queue and number of commands the loop pops at once
+constexpr size_t g_commandQueueSegment = 256;
+constexpr size_t g_commandBatch = 64;
+// Publish commands kept for reuse, and the largest body worth keeping
+constexpr size_t g_spareCommands = 64;
+constexpr size_t g_spareBodyCapacity = 64 * 1024;
+
+// Acks are sent as one multiple ack when this many are collected or the oldest one waits this long
+constexpr size_t g_ackBatchSize = 64;
+constexpr auto g_ackFlushDelay = std::chrono::milliseconds(5);
 
 constexpr bool g_consumePing = true;
 constexpr auto g_pingResponse = "Pong";
 constexpr auto g_pingRequestPayload = g_pingQueue;
 
+// Progress is published when it grew by at least a percent and a quarter of a second has passed
+constexpr auto g_progressMinInterval = std::chrono::milliseconds(250);
+constexpr float g_progressMinDelta = 0.01f;
+
 constexpr auto g_processImageDoneMessage = "Done";
 constexpr auto g_processImageFailMessage = "Fail";
 
+// AMQP message priorities are 0..9 by convention, higher is more urgent
+constexpr uint8_t g_maxMessagePriority = 9;
+
+// Maps message priority onto pool lane, lane 0 is the most urgent one
+size_t laneFromPriority(const AMQP::Message &message, size_t laneCount) {
+  const size_t priority = message.hasPriority() ? std::min(message.priority(), g_maxMessagePriority) : 0;
+  return (laneCount - 1) - priority * (laneCount - 1) / g_maxMessagePriority;
+}
+
+// Time left until the per-message TTL runs out, counted from the publish timestamp when the publisher set one.
+// Returns false if the message has no (valid) expiration.
+bool timeToExpire(const AMQP::Message &message, std::chrono::milliseconds &left) {
+  if (!message.hasExpiration()) {
+    return false;
+  }
+
+  const std::string &expiration = message.expiration();
+  uint64_t ttl = 0;
+  const auto [ptr, ec] = std::from_chars(expiration.data(), expiration.data() + expiration.size(), ttl);
+  if (ec != std::errc()) {
+    return false;
+  }
+
+  left = std::chrono::milliseconds(ttl);
+  if (message.hasTimestamp()) {
+    // AMQP timestamp is in seconds since epoch
+    const auto published = std::chrono::system_clock::time_point(std::chrono::seconds(message.timestamp()));
+    left -= std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - published);
+  }
+  return true;
+}
+
+// Unless set explicitly, saturation is reported early enough to fit messages that the broker
+// has already prefetched to us when consumption is paused.
+limb::tp::ThreadPoolOptions withDefaultWatermarks(limb::tp::ThreadPoolOptions options, size_t prefetchCount) {
+  if (options.highWatermark() != 0) {
+    return options;
+  }
+
+  // Elastic pool may shrink to its minimal size, so is its guaranteed capacity
+  const size_t capacity = options.minThreadCount() * options.queueSize();
+  const size_t high = capacity > prefetchCount * 2 ? capacity - prefetchCount : std::max<size_t>(1, capacity / 2);
+  options.setWatermarks(high / 2, high);
+  return options;
+}
+
 } // namespace
 
 namespace limb {
 AmqpTransport::AmqpTransport(const AmqpConfig &conf, const tp::ThreadPoolOptions &options)
     : m_handler(conf.host.c_str(), conf.port), m_connection(&m_handler, AMQP::Login(conf.user, conf.passwd), "/"),
-      m_ch(&m_connection), m_conf(conf), m_pool(options) {}
+      m_ch(&m_connection), m_commands(g_commandQueueSegment), m_commandBatch(g_commandBatch),
+      m_spareCommands(g_spareCommands), m_acks(g_ackBatchSize), m_conf(conf), m_draining(false),
+      m_pool(withDefaultWatermarks(options, conf.prefetchCount)) {
+  m_handler.setLoopHandler([this]() { runCommands(); });
+  m_pool.setWatermarkHandler([this](bool saturated) { onPoolSaturation(saturated); });
+  m_pool.setResizeHandler([](size_t from, size_t to) {
+    // TODO Implement logging with log levels
+    std::cout << "[AmqpTransport] Worker pool resized " << from << " -> " << to << "\n";
+  });
+}
 
 AmqpTransport::~AmqpTransport() { m_handler.quit(); }
 
@@ -33,9 +118,42 @@ liret AmqpTransport::loop() {
   return liret::kOk;
 }
 
-void AmqpTransport::quit() { m_handler.quit(); }
+void AmqpTransport::quit() {
+  enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kFlushAcks});
+  m_handler.quit();
+}
+
+tp::ThreadPoolStats AmqpTransport::poolStats() const { return m_pool.stats(); }
+
+tp::ThreadPool &AmqpTransport::pool() { return m_pool; }
+
+liret AmqpTransport::init(const std::vector<AppInfoTask::AvailableProcessor> &processors) {
+  if (m_conf.sharedProcessImageQueue) {
+    m_processQueues.push_back(
+        {.name = g_processImageQueue, .modelId = ImageTask::NO_MODEL, .maxPrefetch = m_conf.prefetchCount});
+  }
+  for (const AppInfoTask::AvailableProcessor &processor : processors) {
+    ProcessImageQueue queue{.name = std::string(g_processImageQueue) + "." + processor.name,
+                            .modelId = processor.index,
+                            .maxPrefetch = m_conf.prefetchCount};
+    for (const ProcessorQueueConfig &queueConf : m_conf.processorQueues) {
+      if (queueConf.processor != processor.name) {
+        continue;
+      }
+      queue.maxPrefetch = queueConf.prefetchCount != 0 ? queueConf.prefetchCount : queue.maxPrefetch;
+      if (queueConf.concurrency != 0) {
+        queue.limit = std::make_unique<tp::ResourceScheduler>(queueConf.concurrency,
+                                                              std::vector<tp::ResourceScheduler::Device>());
+      }
+    }
+    m_processQueues.push_back(std::move(queue));
+  }
+  if (m_processQueues.empty()) {
+    // TODO Implement logging with log levels
+    std::cerr << "[AmqpTransport] No " << g_processImageQueue << " queue to consume\n";
+    return liret::kInvalidInput;
+  }
 
-liret AmqpTransport::init() {
   m_ch.setQos(m_conf.prefetchCount);
   if (!m_ch.usable()) {
     return liret::kAborted;
@@ -59,72 +177,384 @@ liret AmqpTransport::init() {
     handleGetAppInfo(message, deliveryTag);
   });
 
-  m_ch.declareQueue(g_processImageQueue);
-  m_ch.consume(g_processImageQueue)
+  m_ch.declareQueue(g_cancelProcessImageQueue);
+  m_ch.consume(g_cancelProcessImageQueue)
       .onReceived([this](const AMQP::Message &message, uint64_t deliveryTag, bool redelivered) {
         // TODO Implement logging with log levels
-        std::cout << "[AmqpTransport] ProcessImage id:" << message.correlationID() << "\n";
+        std::cout << "[AmqpTransport] CancelProcessImage id:" << message.correlationID() << "\n";
 
-        const auto first = reinterpret_cast<const uint8_t *>(message.body());
-        const auto last = reinterpret_cast<const uint8_t *>(message.body()) + message.bodySize();
+        cancelTask(message.correlationID());
+        sendAck(deliveryTag);
+      });
 
-        AmqpTask task{.correlationID = message.correlationID(),
-                      .replyTo = message.replyTo(),
-                      .deliveryTag = deliveryTag,
-                      .body{first, last}};
+  // Last, QoS of the channel is changed for these consumers
+  for (ProcessImageQueue &queue : m_processQueues) {
+    m_ch.declareQueue(queue.name);
+    consumeProcessImage(queue);
+  }
+  scheduleAdjustPrefetch();
+
+  return liret::kOk;
+}
 
-        std::packaged_task<void()> packaged([this, t = std::move(task)]() mutable { handleProcessImage(t); });
-        if (m_pool.tryPost(packaged) == false) {
-          sendReject(deliveryTag);
+uint16_t AmqpTransport::prefetchTarget(const ProcessImageQueue &queue) {
+  size_t inflight = 0;
+  {
+    std::lock_guard lock(m_inflightMutex);
+    inflight = m_inflight.size();
+  }
+  return prefetchForCapacity(m_pool.threadCount() * g_deliveriesPerWorker, inflight, m_processQueues.size(),
+                             queue.maxPrefetch);
+}
+
+void AmqpTransport::scheduleAdjustPrefetch() {
+  m_prefetchTimer = m_pool.postAfter(
+      g_prefetchInterval, [this]() { enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kAdjustPrefetch}); });
+}
+
+void AmqpTransport::adjustPrefetch() {
+  if (!m_consuming || m_draining) {
+    return;
+  }
+
+  for (ProcessImageQueue &queue : m_processQueues) {
+    // Small changes wait until they add up
+    const uint16_t target = prefetchTarget(queue);
+    if (!prefetchWorthChanging(queue.prefetch, target)) {
+      continue;
+    }
+
+    // TODO Implement logging with log levels
+    std::cout << "[AmqpTransport] " << queue.name << " prefetch " << queue.prefetch << " -> " << target << "\n";
+    m_ch.cancel(queue.name);
+    consumeProcessImage(queue, target);
+  }
+}
+
+void AmqpTransport::consumeProcessImage(ProcessImageQueue &queue, uint16_t prefetch) {
+  // Per consumer prefetch applies to consumers started afterwards, deliveries of a cancelled consumer which are
+  // still in flight don't count against it, so the target covers free capacity only
+  queue.prefetch = prefetch != 0 ? prefetch : prefetchTarget(queue);
+  m_consuming = true;
+  m_ch.setQos(queue.prefetch);
+  m_ch.consume(queue.name, queue.name)
+      .onReceived([this, &queue](const AMQP::Message &message, uint64_t deliveryTag, bool redelivered) {
+        // TODO Implement logging with log levels
+        std::cout << "[AmqpTransport] " << queue.name << " id:" << message.correlationID() << "\n";
+
+        // Prefetched before the consumer was cancelled
+        if (m_draining) {
+          sendRequeue(deliveryTag);
+          return;
+        }
+
+        // The only copy of the delivery, the worker and the parser read it in place
+        MessageBody body =
+            m_bodies.acquire(message.body(), message.bodySize(), message.correlationID(), message.replyTo());
+        AmqpTask task{.correlationID = body.correlationID(),
+                      .replyTo = body.replyTo(),
+                      .deliveryTag = deliveryTag,
+                      .modelId = queue.modelId,
+                      .body = std::move(body),
+                      .token = trackTask(message, deliveryTag)};
+
+        const size_t lane = laneFromPriority(message, m_pool.laneCount());
+
+        // Fits into the pool's inline task storage, so posting doesn't allocate. The handler coroutine takes the
+        // task over and suspends on its blocking steps, its frame comes from the pooled frame allocator.
+        auto job = [this, t = std::move(task), &queue, lane]() mutable {
+          runProcessImage(std::move(t), queue, lane).detach();
+        };
+        // Runs on the loop thread, which must not wait for the pool. The consumer is paused when the pool fills
+        // up, deliveries prefetched before that go back to the queue.
+        if (m_pool.tryPost(job, lane) == false) {
+          untrackTask(deliveryTag);
+          sendRequeue(deliveryTag);
         }
       });
+}
 
-  return liret::kOk;
+void AmqpTransport::onPoolSaturation(bool saturated) {
+  using Kind = ChannelCommand::Kind;
+  enqueue(ChannelCommand{.kind = saturated ? Kind::kPauseConsumer : Kind::kResumeConsumer});
 }
 
-void AmqpTransport::sendResponse(AmqpTask &task, const std::vector<uint8_t> &resp) {
-  AMQP::Envelope env((const char *)resp.data(), resp.size());
-  env.setCorrelationID(task.correlationID);
+void AmqpTransport::enqueue(ChannelCommand command) {
+  m_commands.push(std::move(command));
+  m_handler.wake();
+}
 
-  const auto &repl = task.replyTo;
+void AmqpTransport::runCommands() {
+  size_t count;
+  while ((count = m_commands.popN(m_commandBatch.begin(), m_commandBatch.size())) != 0) {
+    for (size_t i = 0; i < count; ++i) {
+      ChannelCommand &command = m_commandBatch[i];
+      runCommand(command);
+      if (command.kind == ChannelCommand::Kind::kPublish && command.body.capacity() <= g_spareBodyCapacity) {
+        m_spareCommands.push(std::move(command));
+      }
+      command = ChannelCommand();
+    }
+  }
+}
 
-  std::lock_guard lock(m_chMutex);
-  if (!m_ch.publish("", repl, env)) {
-    std::cerr << "[AmqpTransport] sendResponse (AmqpTask) Failed to send task! id:" << task.correlationID << "\n";
+void AmqpTransport::runCommand(ChannelCommand &command) {
+  using Kind = ChannelCommand::Kind;
+  switch (command.kind) {
+  case Kind::kPublish: {
+    AMQP::Envelope env((const char *)command.body.data(), command.body.size());
+    env.setCorrelationID(command.correlationID);
+    if (!m_ch.publish("", command.replyTo, env)) {
+      // TODO Implement logging with log levels
+      std::cerr << "[AmqpTransport] sendResponse Failed to send task! id:" << command.correlationID << "\n";
+    }
+    if (command.ack) {
+      batchAck(command.deliveryTag);
+    }
+    break;
+  }
+  case Kind::kAck:
+    batchAck(command.deliveryTag);
+    break;
+  case Kind::kReject:
+  case Kind::kRequeue:
+    if (!m_acks.settle(command.deliveryTag)) {
+      // TODO Implement logging with log levels
+      std::cerr << "[AmqpTransport] Delivery is settled already, reject dropped! tag:" << command.deliveryTag << "\n";
+      break;
+    }
+    m_ch.reject(command.deliveryTag, command.kind == Kind::kRequeue ? AMQP::requeue : 0);
+    break;
+  case Kind::kFlushAcks:
+    flushAcks();
+    break;
+  case Kind::kAdjustPrefetch:
+    adjustPrefetch();
+    if (!m_draining) {
+      scheduleAdjustPrefetch();
+    }
+    break;
+  case Kind::kPauseConsumer:
+    // TODO Implement logging with log levels
+    std::cout << "[AmqpTransport] Pool is saturated, pausing " << g_processImageQueue << " consumers\n";
+    m_consuming = false;
+    for (const ProcessImageQueue &queue : m_processQueues) {
+      m_ch.cancel(queue.name);
+    }
+    break;
+  case Kind::kResumeConsumer:
+    // Drain may have started since the pool reported it
+    if (!m_draining) {
+      std::cout << "[AmqpTransport] Pool is drained, resuming " << g_processImageQueue << " consumers\n";
+      for (ProcessImageQueue &queue : m_processQueues) {
+        consumeProcessImage(queue);
+      }
+    }
+    break;
   }
 }
 
-void AmqpTransport::sendResponse(const AMQP::Message &message, uint64_t deliveryTag, const std::vector<uint8_t> &resp) {
-  AMQP::Envelope env((const char *)resp.data(), resp.size());
-  env.setCorrelationID(message.correlationID());
+DrainStats AmqpTransport::drain(std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+  m_draining = true;
+  enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kPauseConsumer});
+
+  DrainStats stats;
+  std::vector<uint64_t> pending;
+  std::unique_lock lock(m_inflightMutex);
+  // Jobs of deliveries dropped here find them untracked and don't start
+  for (auto it = m_inflight.begin(); it != m_inflight.end();) {
+    if (it->second.started) {
+      ++it;
+      continue;
+    }
+    pending.push_back(it->first);
+    it = m_inflight.erase(it);
+  }
+  const size_t running = m_inflight.size();
+  lock.unlock();
 
-  const auto &repl = message.replyTo();
+  for (uint64_t deliveryTag : pending) {
+    sendRequeue(deliveryTag);
+  }
+  stats.requeued = pending.size();
+
+  // TODO Implement logging with log levels
+  std::cout << "[AmqpTransport] Draining, " << running << " running, " << stats.requeued << " requeued\n";
+
+  lock.lock();
+  m_inflightCv.wait_until(lock, deadline, [this]() { return m_inflight.empty(); });
+  stats.cancelled = m_inflight.size();
+  stats.finished = running - stats.cancelled;
+  for (auto &[tag, task] : m_inflight) {
+    task.requeue = true;
+    task.source.cancel();
+  }
 
-  std::lock_guard lock(m_chMutex);
-  m_ch.publish("", repl, env);
-  m_ch.ack(deliveryTag);
+  m_inflightCv.wait_for(lock, g_drainCancelGrace, [this]() { return m_inflight.empty(); });
+  stats.abandoned = m_inflight.size();
+  stats.cancelled -= stats.abandoned;
+  return stats;
 }
 
-void AmqpTransport::sendResponse(const AMQP::Message &message, uint64_t deliveryTag, const std::string &resp) {
-  AMQP::Envelope env(resp);
-  env.setCorrelationID(message.correlationID());
+tp::CancellationToken AmqpTransport::trackTask(const AMQP::Message &message, uint64_t deliveryTag) {
+  tp::CancellationSource source;
+  std::chrono::milliseconds left;
+  if (timeToExpire(message, left)) {
+    source.cancelAfter(left);
+  }
+
+  std::lock_guard lock(m_inflightMutex);
+  m_inflight.insert_or_assign(deliveryTag, InflightTask{.correlationID = message.correlationID(), .source = source});
+  return source.token();
+}
 
-  const auto &repl = message.replyTo();
+void AmqpTransport::untrackTask(uint64_t deliveryTag) {
+  {
+    std::lock_guard lock(m_inflightMutex);
+    m_inflight.erase(deliveryTag);
+  }
+  m_inflightCv.notify_all();
+}
 
-  std::lock_guard lock(m_chMutex);
-  m_ch.publish("", repl, env);
-  m_ch.ack(deliveryTag);
+bool AmqpTransport::startTask(uint64_t deliveryTag) {
+  std::lock_guard lock(m_inflightMutex);
+  auto it = m_inflight.find(deliveryTag);
+  if (it == m_inflight.end()) {
+    return false;
+  }
+  it->second.started = true;
+  return true;
 }
 
-void AmqpTransport::sendReject(uint64_t deliveryTag) { m_ch.reject(deliveryTag); }
+void AmqpTransport::cancelTask(const std::string &correlationID) {
+  std::lock_guard lock(m_inflightMutex);
+  for (auto &[tag, task] : m_inflight) {
+    if (task.correlationID == correlationID) {
+      task.source.cancel();
+    }
+  }
+}
 
-void AmqpTransport::sendAck(uint64_t deliveryTag) {
-  if (!m_ch.ack(deliveryTag)) {
+tp::CoTask<void> AmqpTransport::runProcessImage(AmqpTask task, ProcessImageQueue &queue, size_t lane) {
+  const uint64_t deliveryTag = task.deliveryTag;
+  // Drain waits for tracked deliveries, so the delivery is untracked on every way out
+  struct Untrack {
+    AmqpTransport *transport;
+    uint64_t deliveryTag;
+    ~Untrack() { transport->untrackTask(deliveryTag); }
+  } untrack{this, deliveryTag};
+
+  try {
+    tp::ResourceGrant slot;
+    if (queue.limit) {
+      slot = co_await queue.limit->acquire(m_pool, {.cpu = 1}, lane);
+    }
+    // Deliveries waiting for the cap haven't started, drain may have requeued them meanwhile
+    if (!startTask(deliveryTag)) {
+      co_return;
+    }
+    co_await handleProcessImage(std::move(task));
+  } catch (const std::exception &e) {
+    // TODO Implement logging with log levels
+    std::cerr << "[AmqpTransport] ProcessImage failed! tag:" << deliveryTag << " what:" << e.what() << "\n";
+    settleFailed(deliveryTag);
+  } catch (...) {
     // TODO Implement logging with log levels
-    std::cerr << "[AmqpTransport] sendResponse (AmqpTask) Failed to send ack! tag:" << deliveryTag << "\n";
+    std::cerr << "[AmqpTransport] ProcessImage failed! tag:" << deliveryTag << "\n";
+    settleFailed(deliveryTag);
+  }
+}
+
+void AmqpTransport::settleFailed(uint64_t deliveryTag) {
+  // Another instance may manage while this one is going down, otherwise the request would fail again
+  if (m_draining) {
+    sendRequeue(deliveryTag);
+  } else {
+    sendReject(deliveryTag);
+  }
+}
+
+void AmqpTransport::batchAck(uint64_t deliveryTag) {
+  if (!m_acks.ack(deliveryTag)) {
+    // TODO Implement logging with log levels
+    std::cerr << "[AmqpTransport] Delivery is settled already, ack dropped! tag:" << deliveryTag << "\n";
+    return;
+  }
+
+  if (m_acks.full()) {
+    flushAcks();
+  } else if (m_acks.pending() == 1) {
+    m_ackTimer = m_pool.postAfter(g_ackFlushDelay,
+                                  [this]() { enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kFlushAcks}); });
+  }
+}
+
+void AmqpTransport::flushAcks() {
+  m_ackTimer.cancel();
+  m_acks.flush([this](uint64_t deliveryTag, bool multiple) {
+    if (!m_ch.ack(deliveryTag, multiple ? AMQP::multiple : 0)) {
+      // TODO Implement logging with log levels
+      std::cerr << "[AmqpTransport] sendResponse (AmqpTask) Failed to send ack! tag:" << deliveryTag << "\n";
+    }
+  });
+}
+
+AmqpTransport::ChannelCommand AmqpTransport::publishCommand(uint64_t deliveryTag, bool ack, std::string_view replyTo,
+                                                            std::string_view correlationID, const void *body,
+                                                            size_t size) {
+  ChannelCommand command;
+  m_spareCommands.pop(command);
+  command.kind = ChannelCommand::Kind::kPublish;
+  command.deliveryTag = deliveryTag;
+  command.ack = ack;
+  command.replyTo.assign(replyTo);
+  command.correlationID.assign(correlationID);
+  const auto *bytes = static_cast<const uint8_t *>(body);
+  command.body.assign(bytes, bytes + size);
+  return command;
+}
+
+void AmqpTransport::sendResponse(AmqpTask &task, const std::vector<uint8_t> &resp) {
+  enqueue(publishCommand(task.deliveryTag, false, task.replyTo, task.correlationID, resp.data(), resp.size()));
+}
+
+void AmqpTransport::sendResponse(const AMQP::Message &message, uint64_t deliveryTag, const std::vector<uint8_t> &resp) {
+  enqueue(publishCommand(deliveryTag, true, message.replyTo(), message.correlationID(), resp.data(), resp.size()));
+}
+
+void AmqpTransport::sendResponse(const AMQP::Message &message, uint64_t deliveryTag, const std::string &resp) {
+  enqueue(publishCommand(deliveryTag, true, message.replyTo(), message.correlationID(), resp.data(), resp.size()));
+}
+
+void AmqpTransport::sendReject(uint64_t deliveryTag) {
+  enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kReject, .deliveryTag = deliveryTag});
+}
+
+void AmqpTransport::sendRequeue(uint64_t deliveryTag) {
+  enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kRequeue, .deliveryTag = deliveryTag});
+}
+
+void AmqpTransport::sendCancelled(uint64_t deliveryTag) {
+  bool requeue = false;
+  {
+    std::lock_guard lock(m_inflightMutex);
+    auto it = m_inflight.find(deliveryTag);
+    requeue = it != m_inflight.end() && it->second.requeue;
+  }
+
+  if (requeue) {
+    sendRequeue(deliveryTag);
+  } else {
+    sendReject(deliveryTag);
   }
 }
 
+void AmqpTransport::sendAck(uint64_t deliveryTag) {
+  enqueue(ChannelCommand{.kind = ChannelCommand::Kind::kAck, .deliveryTag = deliveryTag});
+}
+
 AmqpTransportAdapter::AmqpTransportAdapter(const AmqpConfig &conf, const tp::ThreadPoolOptions &options)
     : AmqpTransport(conf, options), m_app(nullptr) {}
 
@@ -136,7 +566,7 @@ liret AmqpTransportAdapter::init(AppBase *app) {
   }
   m_app = app;
 
-  return AmqpTransport::init();
+  return AmqpTransport::init(m_app->getAppInfo().availableProcessors);
 }
 
 void AmqpTransportAdapter::handlePing(const AMQP::Message &message, uint64_t deliveryTag) {
@@ -192,38 +622,70 @@ void AmqpTransportAdapter::handleGetAppInfo(const AMQP::Message &message, uint64
 
 using namespace std::chrono;
 
-void AmqpTransportAdapter::handleProcessImage(AmqpTask &message) {
+tp::CoTask<void> AmqpTransportAdapter::handleProcessImage(AmqpTask message) {
   std::unique_ptr<TaskParser> taskParser(TaskParserFactory::fromType(TaskParserType::kJson));
 
   limb::ImageTask task;
   if (taskParser == nullptr ||
-      taskParser->parse((const uint8_t *)message.body.data(), message.body.size(), task) != liret::kOk) {
+      taskParser->parsePadded(message.body.data(), message.body.size(), task) != liret::kOk) {
     // TODO Implement logging with log levels
     std::cerr << "[AmqpTransportAdapter] handleProcessImage Failed to parse task! id:" << message.correlationID << "\n";
     sendReject(message.deliveryTag);
-    return;
+    co_return;
+  }
+
+  // The processor queue tells the model, requests of the shared queue name it themselves
+  if (message.modelId != ImageTask::NO_MODEL) {
+    task.modelId = message.modelId;
+  }
+  if (task.modelId == ImageTask::NO_MODEL) {
+    // TODO Implement logging with log levels
+    std::cerr << "[AmqpTransportAdapter] handleProcessImage No model id:" << message.correlationID << "\n";
+    sendReject(message.deliveryTag);
+    co_return;
+  }
+
+  if (message.token.isCancelled()) {
+    // TODO Implement logging with log levels
+    std::cout << "[AmqpTransportAdapter] handleProcessImage Cancelled before start id:" << message.correlationID
+              << "\n";
+    sendCancelled(message.deliveryTag);
+    co_return;
   }
 
   auto sendRespVec = [this, &message](const std::vector<uint8_t> &resp) { AmqpTransport::sendResponse(message, resp); };
 
-  auto progressCb = [this, &taskParser, &message, &sendRespVec](float value) {
+  // Reused by every progress message of the request
+  ImageTaskResult progressResult{.status = ImageTaskResult::Status::Progress};
+  std::vector<uint8_t> progressResponse;
+  auto sendProgress = [&taskParser, &message, &sendRespVec, &progressResult, &progressResponse](float value) {
     // TODO use dedicated class to provide response in any format
-    const std::string progress = std::format("{:.2f}", value);
-    ;
+    char text[8];
+    const auto [end, ec] = std::to_chars(text, text + sizeof(text), value, std::chars_format::fixed, 2);
+    progressResult.message.assign(text, end);
     // TODO Implement logging with log levels
-    std::cout << "[AmqpTransportAdapter] handleProcessImage progress:" << progress << "\n";
+    std::cout << "[AmqpTransportAdapter] handleProcessImage progress:" << progressResult.message << "\n";
 
-    std::vector<uint8_t> response;
-    if (taskParser->serialize(response, ImageTaskResult{.message = progress,
-                                                        .status = ImageTaskResult::Status::Progress}) != liret::kOk) {
-      sendReject(message.deliveryTag);
+    if (taskParser->serialize(progressResponse, progressResult) != liret::kOk) {
+      // The delivery is settled once by the final response, a lost progress message is not worth failing it
+      std::cerr << "[AmqpTransportAdapter] handleProcessImage Failed to serialize progress! id:"
+                << message.correlationID << "\n";
       return;
     }
 
-    sendRespVec(response);
+    sendRespVec(progressResponse);
   };
 
-  liret ret = m_app->processImage(task, progressCb);
+  ProgressReporter progress(sendProgress, g_progressMinInterval, g_progressMinDelta);
+  progress.report(0.0f);
+
+  liret ret = co_await m_app->processImageAsync(pool(), task, progress.callback(), message.token);
+  if (ret == liret::kCancelled) {
+    // TODO Implement logging with log levels
+    std::cout << "[AmqpTransportAdapter] handleProcessImage Cancelled id:" << message.correlationID << "\n";
+    sendCancelled(message.deliveryTag);
+    co_return;
+  }
   if (ret != liret::kOk) {
     // TODO Implement logging with log levels
     std::cerr << "[AmqpTransportAdapter] handleProcessImage Error:" << listat::getErrorMessage(ret) << "\n";
@@ -232,20 +694,23 @@ void AmqpTransportAdapter::handleProcessImage(AmqpTask &message) {
     if (taskParser->serialize(response, ImageTaskResult{.message = g_processImageFailMessage,
                                                         .status = ImageTaskResult::Status::Fail}) != liret::kOk) {
       sendReject(message.deliveryTag);
-      return;
+      co_return;
     }
 
     sendRespVec(response);
-    return;
+    sendAck(message.deliveryTag);
+    co_return;
   }
 
   std::cout << "[AmqpTransportAdapter] handleProcessImage Done!\n";
 
+  progress.finish();
+
   std::vector<uint8_t> response;
   if (taskParser->serialize(response, ImageTaskResult{.message = g_processImageDoneMessage,
                                                       .status = ImageTaskResult::Status::Done}) != liret::kOk) {
     sendReject(message.deliveryTag);
-    return;
+    co_return;
   }
 
   sendRespVec(response);
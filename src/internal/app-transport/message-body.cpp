@@ -0,0 +1,85 @@
+#include "app-transport/message-body.hpp"
+
+#include <cstring>
+
+namespace limb {
+
+MessageBodyPool::MessageBodyPool() {
+  for (size_t i = 0; i < CLASS_COUNT; i++) {
+    m_classes[i] = std::make_unique<SizeClass>(CLASS_BUDGET / (MIN_BLOCK << i));
+  }
+}
+
+MessageBody MessageBodyPool::acquire(const void *body, size_t size, std::string_view correlationID,
+                                     std::string_view replyTo) {
+  // AMQP short strings are up to 255 bytes
+  correlationID = correlationID.substr(0, UINT8_MAX);
+  replyTo = replyTo.substr(0, UINT8_MAX);
+  const size_t total = size + MessageBody::PADDING + correlationID.size() + replyTo.size();
+
+  uint16_t sizeClass = 0;
+  while (sizeClass < CLASS_COUNT && (MIN_BLOCK << sizeClass) < total) {
+    sizeClass++;
+  }
+
+  uint8_t *block = sizeClass < CLASS_COUNT ? allocate(sizeClass) : nullptr;
+  if (block == nullptr) {
+    sizeClass = HEAP_CLASS;
+    block = new uint8_t[total];
+  }
+
+  MessageBody result;
+  result.m_pool = this;
+  result.m_sizeClass = sizeClass;
+  result.m_block = block;
+  result.m_size = size;
+  result.m_idSize = uint16_t(correlationID.size());
+  result.m_replySize = uint16_t(replyTo.size());
+
+  uint8_t *out = result.m_block;
+  if (size != 0) {
+    std::memcpy(out, body, size);
+  }
+  out += size;
+  std::memset(out, 0, MessageBody::PADDING);
+  out += MessageBody::PADDING;
+  std::memcpy(out, correlationID.data(), correlationID.size());
+  out += correlationID.size();
+  std::memcpy(out, replyTo.data(), replyTo.size());
+  return result;
+}
+
+uint8_t *MessageBodyPool::allocate(uint16_t sizeClass) {
+  SizeClass &state = *m_classes[sizeClass];
+  uint8_t *block = nullptr;
+  if (state.free.pop(block)) {
+    return block;
+  }
+
+  const size_t blockSize = MIN_BLOCK << sizeClass;
+  std::lock_guard lock(state.mutex);
+  // Released meanwhile
+  if (state.free.pop(block)) {
+    return block;
+  }
+  if ((state.slabs.size() + 1) * SLAB_SIZE > CLASS_BUDGET) {
+    return nullptr;
+  }
+
+  // Free queue holds the whole budget, so pushing a new slab never fails
+  uint8_t *slab = state.slabs.emplace_back(new uint8_t[SLAB_SIZE]).get();
+  for (size_t offset = blockSize; offset < SLAB_SIZE; offset += blockSize) {
+    state.free.push(slab + offset);
+  }
+  return slab;
+}
+
+void MessageBodyPool::release(uint8_t *block, uint16_t sizeClass) noexcept {
+  if (sizeClass == HEAP_CLASS) {
+    delete[] block;
+  } else {
+    m_classes[sizeClass]->free.push(block);
+  }
+}
+
+} // namespace limb
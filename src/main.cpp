@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <amqpcpp.h>
 
@@ -16,9 +21,22 @@
 #include "limb-app.h"
 #include "media-repository/mongo-client.hpp"
 #include "processor-loader.h"
+#include "thread-pool/resource-scheduler.hpp"
 
 #include "utils/bithacks.h"
 
+// Cores kept busy by a single inference on a CPU-only machine
+constexpr size_t g_cpuCoresPerInference = 4;
+
+namespace {
+// Signal handler only flags the stop, the drain runs on a regular thread which polls the flag
+constexpr auto g_stopPollInterval = std::chrono::milliseconds(100);
+// Set by the signal handler, or to -1 once the transport loop ends on its own
+std::atomic<int> g_stopSignal{0};
+
+void onStopSignal(int signal) { g_stopSignal.store(signal); }
+} // namespace
+
 int main(int argc, char **argv) {
   limb::ConfigFactory configF(argc, argv);
   limb::AppConfig config;
@@ -51,36 +69,84 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
 
-  const int queueCount = ncnn::get_gpu_info(ncnn::get_default_gpu_index()).compute_queue_count();
   const int thdCount = std::thread::hardware_concurrency();
+  // One CPU slot per core the workers may run on
+  const size_t cpuSlots = config.workerConfig.cpus.empty() ? thdCount : config.workerConfig.cpus.size();
+
+  // Every GPU runs as many inferences as it has compute queues, within its heap budget
+  std::vector<limb::tp::ResourceScheduler::Device> devices;
+  for (int i = 0; i < ncnn::get_gpu_count(); i++) {
+    devices.push_back({.inferenceSlots = size_t(ncnn::get_gpu_info(i).compute_queue_count()),
+                       .memoryBudget = size_t(ncnn::get_gpu_device(i)->get_heap_budget()) * 1024 * 1024});
+  }
+  if (devices.empty()) {
+    // CPU-only machine, inference slots come from the cores
+    devices.push_back({.inferenceSlots = std::max<size_t>(1, cpuSlots / g_cpuCoresPerInference), .memoryBudget = 0});
+  }
+  limb::tp::ResourceScheduler scheduler(cpuSlots, std::move(devices));
+  imageService.setResourceScheduler(&scheduler);
 
   limb::tp::ThreadPoolOptions options;
-  options.setThreadCount(std::min(queueCount, thdCount));
+  // Workers running inference wait for the device without holding a CPU slot, so the pool grows up to one worker
+  // per CPU slot plus one per inference slot, while the scheduler bounds every kind of work separately
+  options.setThreadCount(cpuSlots);
+  options.setThreadBounds(cpuSlots, cpuSlots + scheduler.inferenceSlots());
+  // Workers blocked on repository I/O are compensated by up to one extra worker per CPU slot
+  options.setMaxCompensationThreads(cpuSlots);
   options.setQueueSize(nextPowerOfTwo(thdCount));
+  // control, interactive and batch tasks
+  options.setLaneCount(3);
+  options.setCpuSet({config.workerConfig.cpus.begin(), config.workerConfig.cpus.end()});
+  if (config.workerConfig.placement == "compact") {
+    options.setPlacement(limb::tp::WorkerPlacement::kCompact);
+  } else if (config.workerConfig.placement == "spread") {
+    options.setPlacement(limb::tp::WorkerPlacement::kSpread);
+  }
 
-  limb::AmqpTransportAdapter transport(config.transportConfig, options);
-  if (transport.init(&application) != liret::kOk) {
-    fprintf(stderr, "failed to amqp transport\n");
-    return EXIT_FAILURE;
+  liret loopRet = liret::kOk;
+  // The transport owns the worker pool, so it is destroyed first: requests abandoned by the drain, or still running
+  // when the loop ends on its own, use the GPU until the pool joins its workers
+  {
+    limb::AmqpTransportAdapter transport(config.transportConfig, options);
+    if (transport.init(&application) != liret::kOk) {
+      fprintf(stderr, "failed to amqp transport\n");
+      return EXIT_FAILURE;
+    }
+
+    // Stop consuming, let running tasks finish and return the rest to the broker, so a restart repeats no work
+    std::signal(SIGTERM, onStopSignal);
+    std::signal(SIGINT, onStopSignal);
+    std::thread stopper([&transport, &config]() {
+      int signal = 0;
+      while ((signal = g_stopSignal.load()) == 0) {
+        std::this_thread::sleep_for(g_stopPollInterval);
+      }
+      if (signal < 0) {
+        return;
+      }
+
+      fprintf(stdout, "[x] Signal %d, draining\n", signal);
+      const limb::DrainStats stats = transport.drain(std::chrono::seconds(config.transportConfig.drainTimeout));
+      fprintf(stdout, "[x] Drained: %zu finished, %zu requeued, %zu cancelled, %zu abandoned\n", stats.finished,
+              stats.requeued, stats.cancelled, stats.abandoned);
+      transport.quit();
+    });
+
+    fprintf(stdout, "[x] Awaiting RPC requests\n");
+
+    loopRet = transport.loop();
+    int running = 0;
+    g_stopSignal.compare_exchange_strong(running, -1);
+    stopper.join();
   }
 
-  fprintf(stdout, "[x] Awaiting RPC requests\n");
+  if (ncnn::get_gpu_instance())
+    ncnn::destroy_gpu_instance();
 
-  if (transport.loop() != liret::kOk) {
+  if (loopRet != liret::kOk) {
     fprintf(stderr, "failed to start amqp transport loop\n");
     return EXIT_FAILURE;
   }
 
-  // For some reason windwos SIGTERM produces thousands of memory leak
-  // Seems like on windows it better aproach
-  // std::thread thd([&handler]() {
-  //   std::this_thread::sleep_for(std::chrono::milliseconds(200));
-  //   handler.quit();
-  // });
-  // thd.join();
-
-  if (ncnn::get_gpu_instance())
-    ncnn::destroy_gpu_instance();
-
   return 0;
 }
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "app-transport/ack-batcher.hpp"
+
+namespace {
+using Acks = std::vector<std::pair<uint64_t, bool>>;
+
+Acks flush(limb::AckBatcher &batcher) {
+  Acks sent;
+  batcher.flush([&sent](uint64_t deliveryTag, bool multiple) { sent.emplace_back(deliveryTag, multiple); });
+  return sent;
+}
+} // namespace
+
+TEST(AckBatcher, multiplePrefix) {
+  limb::AckBatcher batcher(64);
+
+  ASSERT_TRUE(batcher.ack(1));
+  ASSERT_TRUE(batcher.ack(2));
+  ASSERT_TRUE(batcher.ack(3));
+  ASSERT_EQ(3u, batcher.pending());
+  ASSERT_EQ((Acks{{3, true}}), flush(batcher));
+  ASSERT_EQ(0u, batcher.pending());
+
+  // Completed in reverse, still one multiple ack once the gap is filled
+  ASSERT_TRUE(batcher.ack(5));
+  ASSERT_TRUE(batcher.ack(4));
+  ASSERT_EQ((Acks{{5, true}}), flush(batcher));
+  ASSERT_EQ((Acks{}), flush(batcher));
+
+  // Settled deliveries are not acked again
+  ASSERT_FALSE(batcher.ack(3));
+  ASSERT_FALSE(batcher.ack(5));
+}
+
+TEST(AckBatcher, outOfOrder) {
+  limb::AckBatcher batcher(64);
+
+  // Delivery 1 still runs, the completed ones behind it are acked one by one
+  ASSERT_TRUE(batcher.ack(2));
+  ASSERT_TRUE(batcher.ack(4));
+  ASSERT_EQ((Acks{{2, false}, {4, false}}), flush(batcher));
+  ASSERT_FALSE(batcher.ack(2));
+
+  // Multiple ack of 1 covers nothing else, 2 is settled already and 3 still runs
+  ASSERT_TRUE(batcher.ack(1));
+  ASSERT_EQ((Acks{{1, true}}), flush(batcher));
+
+  // 4 was acked singly, so the prefix moves over it
+  ASSERT_TRUE(batcher.ack(3));
+  ASSERT_TRUE(batcher.ack(5));
+  ASSERT_EQ((Acks{{5, true}}), flush(batcher));
+}
+
+TEST(AckBatcher, longRunning) {
+  limb::AckBatcher batcher(4);
+
+  // Delivery 1 runs through several batches, everything completed meanwhile is acked singly
+  for (uint64_t batch = 0; batch < 3; ++batch) {
+    const uint64_t first = 2 + batch * 4;
+    for (uint64_t deliveryTag = first; deliveryTag < first + 4; ++deliveryTag) {
+      ASSERT_TRUE(batcher.ack(deliveryTag));
+    }
+    ASSERT_TRUE(batcher.full());
+    ASSERT_EQ((Acks{{first, false}, {first + 1, false}, {first + 2, false}, {first + 3, false}}), flush(batcher));
+  }
+
+  // Once it completes, the prefix moves over all of them and multiple acks are back
+  ASSERT_TRUE(batcher.ack(1));
+  ASSERT_TRUE(batcher.ack(14));
+  ASSERT_TRUE(batcher.ack(15));
+  ASSERT_EQ((Acks{{15, true}}), flush(batcher));
+}
+
+TEST(AckBatcher, rejectAndRequeue) {
+  limb::AckBatcher batcher(64);
+
+  ASSERT_TRUE(batcher.ack(1));
+  // Rejected and requeued deliveries are settled by the caller and only move the prefix
+  ASSERT_TRUE(batcher.settle(2));
+  ASSERT_TRUE(batcher.ack(3));
+  ASSERT_TRUE(batcher.settle(4));
+  ASSERT_TRUE(batcher.ack(6));
+  ASSERT_EQ(3u, batcher.pending());
+  ASSERT_EQ((Acks{{3, true}, {6, false}}), flush(batcher));
+
+  ASSERT_FALSE(batcher.settle(2));
+  ASSERT_FALSE(batcher.ack(4));
+  ASSERT_FALSE(batcher.settle(6));
+
+  // A settled gap lets the later acks join the prefix
+  ASSERT_TRUE(batcher.ack(7));
+  ASSERT_TRUE(batcher.settle(5));
+  ASSERT_EQ((Acks{{7, true}}), flush(batcher));
+}
+
+TEST(AckBatcher, full) {
+  limb::AckBatcher batcher(2);
+
+  ASSERT_TRUE(batcher.ack(1));
+  ASSERT_FALSE(batcher.full());
+  ASSERT_TRUE(batcher.ack(3));
+  ASSERT_TRUE(batcher.full());
+  ASSERT_EQ((Acks{{1, true}, {3, false}}), flush(batcher));
+  ASSERT_FALSE(batcher.full());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
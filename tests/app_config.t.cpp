@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "app-config.h"
+#include "json-parser.h"
+
+namespace {
+// Parses the transport section inside an otherwise complete config
+liret parseTransport(std::string_view transport, limb::AppConfig &conf) {
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "limb_app_config_test.json";
+  {
+    std::ofstream file(path, std::ios::trunc);
+    file << R"({"application": {"database": {"type": "mongo", "uri": "mongodb://localhost", "dbName": "LimbDB"},)"
+         << R"("transport": {"type": "amqp", "user": "u", "passwd": "p", "host": "127.0.0.1", "port": 5672)"
+         << transport << "}}}";
+  }
+
+  limb::JsonParser parser(path.string());
+  const liret ret = parser.getConfig(conf);
+  std::filesystem::remove(path);
+  return ret;
+}
+} // namespace
+
+TEST(AppConfig, drainTimeout) {
+  limb::AppConfig defaults;
+  ASSERT_EQ(liret::kOk, parseTransport("", defaults));
+  ASSERT_EQ(30, defaults.transportConfig.drainTimeout);
+
+  limb::AppConfig custom;
+  ASSERT_EQ(liret::kOk, parseTransport(R"(, "drainTimeout": 5)", custom));
+  ASSERT_EQ(5, custom.transportConfig.drainTimeout);
+
+  limb::AppConfig tooLong;
+  ASSERT_EQ(liret::kIncomplete, parseTransport(R"(, "drainTimeout": 65536)", tooLong));
+
+  limb::AppConfig negative;
+  ASSERT_EQ(liret::kIncomplete, parseTransport(R"(, "drainTimeout": -1)", negative));
+}
+
+TEST(AppConfig, processorQueues) {
+  limb::AppConfig defaults;
+  ASSERT_EQ(liret::kOk, parseTransport("", defaults));
+  ASSERT_TRUE(defaults.transportConfig.sharedProcessImageQueue);
+  ASSERT_TRUE(defaults.transportConfig.processorQueues.empty());
+
+  limb::AppConfig custom;
+  ASSERT_EQ(liret::kOk, parseTransport(R"(, "sharedProcessImageQueue": false, "processorQueues": [
+      {"processor": "realesrgan", "prefetchCount": 4, "concurrency": 1}, {"processor": "rmbg"}])",
+                                       custom));
+  const limb::AmqpConfig &transport = custom.transportConfig;
+  ASSERT_FALSE(transport.sharedProcessImageQueue);
+  ASSERT_EQ(2u, transport.processorQueues.size());
+  ASSERT_EQ("realesrgan", transport.processorQueues[0].processor);
+  ASSERT_EQ(4, transport.processorQueues[0].prefetchCount);
+  ASSERT_EQ(1, transport.processorQueues[0].concurrency);
+  ASSERT_EQ("rmbg", transport.processorQueues[1].processor);
+  ASSERT_EQ(0, transport.processorQueues[1].prefetchCount);
+  ASSERT_EQ(0, transport.processorQueues[1].concurrency);
+
+  limb::AppConfig noName;
+  ASSERT_EQ(liret::kIncomplete, parseTransport(R"(, "processorQueues": [{"concurrency": 1}])", noName));
+
+  limb::AppConfig tooMany;
+  ASSERT_EQ(liret::kIncomplete,
+            parseTransport(R"(, "processorQueues": [{"processor": "rmbg", "prefetchCount": 70000}])", tooMany));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
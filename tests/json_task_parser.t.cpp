@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "app-tasks/task-parser.hpp"
+
+namespace {
+// Request followed by the padding parsePadded reads
+std::vector<uint8_t> padded(std::string_view json) {
+  std::vector<uint8_t> data(json.size() + limb::PARSE_PADDING, 0);
+  std::copy(json.begin(), json.end(), data.begin());
+  return data;
+}
+
+std::unique_ptr<limb::TaskParser> jsonParser() {
+  return std::unique_ptr<limb::TaskParser>(limb::TaskParserFactory::fromType(limb::TaskParserType::kJson));
+}
+} // namespace
+
+TEST(JsonTaskParser, parsePadded) {
+  auto parser = jsonParser();
+  ASSERT_NE(nullptr, parser);
+
+  constexpr std::string_view json = R"({"modelId":3,"imageId":"0123456789abcdef"})";
+  const std::vector<uint8_t> data = padded(json);
+  limb::ImageTask task;
+  ASSERT_EQ(liret::kOk, parser->parsePadded(data.data(), json.size(), task));
+  ASSERT_EQ(3u, task.modelId);
+  ASSERT_EQ("0123456789abcdef", task.imageId);
+
+  // Same result as the copying parse
+  limb::ImageTask copied;
+  ASSERT_EQ(liret::kOk, parser->parse(data.data(), json.size(), copied));
+  ASSERT_EQ(task.modelId, copied.modelId);
+  ASSERT_EQ(task.imageId, copied.imageId);
+}
+
+TEST(JsonTaskParser, parsePaddedInvalid) {
+  auto parser = jsonParser();
+  limb::ImageTask task;
+
+  const std::vector<uint8_t> empty = padded("");
+  ASSERT_EQ(liret::kInvalidInput, parser->parsePadded(empty.data(), 0, task));
+  ASSERT_EQ(liret::kInvalidInput, parser->parsePadded(nullptr, 10, task));
+
+  constexpr std::string_view noImage = R"({"modelId":3})";
+  const std::vector<uint8_t> data = padded(noImage);
+  ASSERT_EQ(liret::kInvalidInput, parser->parsePadded(data.data(), noImage.size(), task));
+}
+
+TEST(JsonTaskParser, optionalModel) {
+  auto parser = jsonParser();
+  limb::ImageTask task{.modelId = 3};
+
+  // Requests of the processor queues leave the model out
+  constexpr std::string_view noModel = R"({"imageId":"0123456789abcdef"})";
+  const std::vector<uint8_t> data = padded(noModel);
+  ASSERT_EQ(liret::kOk, parser->parsePadded(data.data(), noModel.size(), task));
+  ASSERT_EQ(limb::ImageTask::NO_MODEL, task.modelId);
+  ASSERT_EQ("0123456789abcdef", task.imageId);
+
+  // NO_MODEL is reserved, so a request can't name it, nor anything past it
+  for (std::string_view json : {R"({"modelId":4294967295,"imageId":"a"})", R"({"modelId":4294967296,"imageId":"a"})",
+                                R"({"modelId":-1,"imageId":"a"})", R"({"modelId":"1","imageId":"a"})"}) {
+    const std::vector<uint8_t> invalid = padded(json);
+    ASSERT_EQ(liret::kInvalidInput, parser->parsePadded(invalid.data(), json.size(), task)) << json;
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
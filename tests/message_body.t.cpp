@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "app-transport/message-body.hpp"
+
+namespace {
+using limb::MessageBody;
+using limb::MessageBodyPool;
+
+bool paddingIsZero(const MessageBody &body) {
+  const uint8_t *padding = body.data() + body.size();
+  return std::all_of(padding, padding + MessageBody::PADDING, [](uint8_t byte) { return byte == 0; });
+}
+} // namespace
+
+TEST(MessageBodyPool, sizeClasses) {
+  MessageBodyPool pool;
+  const std::vector<uint8_t> data(MessageBodyPool::SLAB_SIZE, 'x');
+
+  // Blocks of a fresh size class follow each other in the slab
+  for (size_t sizeClass = 0; sizeClass + 1 < MessageBodyPool::CLASS_COUNT; ++sizeClass) {
+    const size_t blockSize = MessageBodyPool::MIN_BLOCK << sizeClass;
+    // Body, padding and ids fill the block exactly
+    const size_t size = blockSize - MessageBody::PADDING - 2;
+    MessageBody first = pool.acquire(data.data(), size, "i", "r");
+    MessageBody second = pool.acquire(data.data(), size, "i", "r");
+    ASSERT_TRUE(first.pooled());
+    ASSERT_EQ(blockSize, size_t(second.data() - first.data())) << sizeClass;
+  }
+
+  // One byte more takes the next size
+  const size_t size = MessageBodyPool::MIN_BLOCK - MessageBody::PADDING - 1;
+  MessageBody first = pool.acquire(data.data(), size, "i", "r");
+  MessageBody second = pool.acquire(data.data(), size, "i", "r");
+  ASSERT_EQ(2 * MessageBodyPool::MIN_BLOCK, size_t(second.data() - first.data()));
+
+  // The largest size holds a block per slab
+  MessageBody largest = pool.acquire(data.data(), MessageBodyPool::SLAB_SIZE - MessageBody::PADDING, "", "");
+  ASSERT_TRUE(largest.pooled());
+}
+
+TEST(MessageBodyPool, zeroPadding) {
+  MessageBodyPool pool;
+  const std::vector<uint8_t> junk(190, 0xff);
+  const std::vector<uint8_t> small(10, 'x');
+
+  // Enough rounds to go through every block of the first slab, so later blocks are reused
+  for (size_t i = 0; i < 2 * MessageBodyPool::SLAB_SIZE / MessageBodyPool::MIN_BLOCK; ++i) {
+    MessageBody dirty = pool.acquire(junk.data(), junk.size(), "", "");
+    ASSERT_TRUE(paddingIsZero(dirty));
+    dirty = MessageBody();
+
+    MessageBody body = pool.acquire(small.data(), small.size(), "id", "reply");
+    ASSERT_EQ(small, std::vector<uint8_t>(body.data(), body.data() + body.size()));
+    ASSERT_TRUE(paddingIsZero(body)) << i;
+  }
+}
+
+TEST(MessageBodyPool, heapFallback) {
+  MessageBodyPool pool;
+  std::vector<uint8_t> data(MessageBodyPool::SLAB_SIZE + 1);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i);
+  }
+
+  MessageBody body = pool.acquire(data.data(), data.size(), "id", "reply");
+  ASSERT_FALSE(body.pooled());
+  ASSERT_EQ(data, std::vector<uint8_t>(body.data(), body.data() + body.size()));
+  ASSERT_TRUE(paddingIsZero(body));
+  ASSERT_EQ("id", body.correlationID());
+  ASSERT_EQ("reply", body.replyTo());
+}
+
+TEST(MessageBodyPool, budget) {
+  MessageBodyPool pool;
+  const std::vector<uint8_t> data(MessageBodyPool::SLAB_SIZE / 2 + 1, 'x');
+  const size_t blocks = MessageBodyPool::CLASS_BUDGET / MessageBodyPool::SLAB_SIZE;
+
+  std::vector<MessageBody> held;
+  for (size_t i = 0; i < blocks; ++i) {
+    held.push_back(pool.acquire(data.data(), data.size(), "", ""));
+    ASSERT_TRUE(held.back().pooled()) << i;
+  }
+
+  // Past the budget deliveries go to the heap, until a pooled block is returned
+  MessageBody overflow = pool.acquire(data.data(), data.size(), "", "");
+  ASSERT_FALSE(overflow.pooled());
+  ASSERT_EQ(data, std::vector<uint8_t>(overflow.data(), overflow.data() + overflow.size()));
+  ASSERT_TRUE(paddingIsZero(overflow));
+
+  held.pop_back();
+  MessageBody returned = pool.acquire(data.data(), data.size(), "", "");
+  ASSERT_TRUE(returned.pooled());
+}
+
+TEST(MessageBodyPool, views) {
+  MessageBodyPool pool;
+  const std::string json = R"({"imageId":"42"})";
+  const std::string replyTo = "amq.rabbitmq.reply-to.g1h2AA5yZXBseUAxMjM0NTY3OAAAAAAAAAAA";
+
+  MessageBody body = pool.acquire(json.data(), json.size(), "correlation", replyTo);
+  ASSERT_EQ(json.size(), body.size());
+  ASSERT_EQ(json, std::string(reinterpret_cast<const char *>(body.data()), body.size()));
+  ASSERT_EQ("correlation", body.correlationID());
+  ASSERT_EQ(replyTo, body.replyTo());
+
+  // Views follow the block when the body is moved
+  const uint8_t *data = body.data();
+  MessageBody moved(std::move(body));
+  ASSERT_EQ(nullptr, body.data());
+  ASSERT_EQ(0u, body.size());
+  ASSERT_EQ(data, moved.data());
+  ASSERT_EQ("correlation", moved.correlationID());
+  ASSERT_EQ(replyTo, moved.replyTo());
+
+  // AMQP short strings are up to 255 bytes
+  const std::string longId(300, 'c');
+  MessageBody empty = pool.acquire(nullptr, 0, longId, "");
+  ASSERT_TRUE(empty.pooled());
+  ASSERT_EQ(0u, empty.size());
+  ASSERT_TRUE(paddingIsZero(empty));
+  ASSERT_EQ(std::string(255, 'c'), empty.correlationID());
+  ASSERT_EQ("", empty.replyTo());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
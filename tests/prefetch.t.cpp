@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include "app-transport/prefetch.hpp"
+
+TEST(Prefetch, followsFreeCapacity) {
+  ASSERT_EQ(16, limb::prefetchForCapacity(16, 0, 1, 100));
+  ASSERT_EQ(6, limb::prefetchForCapacity(16, 10, 1, 100));
+  // Split between the queues
+  ASSERT_EQ(3, limb::prefetchForCapacity(16, 10, 2, 100));
+  ASSERT_EQ(8, limb::prefetchForCapacity(16, 0, 2, 100));
+}
+
+TEST(Prefetch, bounds) {
+  // Busy pool still takes one delivery per queue
+  ASSERT_EQ(1, limb::prefetchForCapacity(16, 16, 1, 100));
+  ASSERT_EQ(1, limb::prefetchForCapacity(16, 40, 1, 100));
+  ASSERT_EQ(1, limb::prefetchForCapacity(16, 15, 4, 100));
+  // Configured limit, zero meaning one
+  ASSERT_EQ(4, limb::prefetchForCapacity(16, 0, 1, 4));
+  ASSERT_EQ(1, limb::prefetchForCapacity(16, 0, 1, 0));
+  ASSERT_EQ(16, limb::prefetchForCapacity(16, 0, 0, 100));
+}
+
+TEST(Prefetch, hysteresis) {
+  ASSERT_FALSE(limb::prefetchWorthChanging(10, 10));
+  ASSERT_FALSE(limb::prefetchWorthChanging(10, 14));
+  ASSERT_FALSE(limb::prefetchWorthChanging(10, 7));
+  ASSERT_TRUE(limb::prefetchWorthChanging(10, 15));
+  ASSERT_TRUE(limb::prefetchWorthChanging(10, 6));
+  ASSERT_FALSE(limb::prefetchWorthChanging(1, 1));
+  ASSERT_TRUE(limb::prefetchWorthChanging(1, 2));
+  ASSERT_TRUE(limb::prefetchWorthChanging(2, 1));
+  // Products don't overflow
+  ASSERT_FALSE(limb::prefetchWorthChanging(60000, 65535));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "utils/progress-reporter.h"
+
+namespace {
+struct Sink {
+  limb::ProgressCallback callback() {
+    return [this](float progress) { reported.push_back(progress); };
+  }
+
+  std::vector<float> reported;
+};
+} // namespace
+
+TEST(ProgressReporter, deltaGating) {
+  Sink sink;
+  limb::ProgressReporter reporter(sink.callback(), std::chrono::seconds(0), 0.1f);
+
+  reporter.report(0.0f);
+  reporter.report(0.05f);
+  reporter.report(0.25f);
+  // Too small a step, and going back
+  reporter.report(0.3f);
+  reporter.report(0.2f);
+  reporter.report(0.5f);
+  ASSERT_EQ((std::vector<float>{0.0f, 0.25f, 0.5f}), sink.reported);
+}
+
+TEST(ProgressReporter, intervalGating) {
+  Sink sink;
+  const auto interval = std::chrono::milliseconds(200);
+  limb::ProgressReporter reporter(sink.callback(), interval, 0.0f);
+
+  reporter.report(0.0f);
+  reporter.report(0.5f);
+  ASSERT_EQ((std::vector<float>{0.0f}), sink.reported);
+
+  std::this_thread::sleep_for(interval + std::chrono::milliseconds(50));
+  reporter.report(0.6f);
+  reporter.report(0.7f);
+  ASSERT_EQ((std::vector<float>{0.0f, 0.6f}), sink.reported);
+}
+
+TEST(ProgressReporter, firstAlwaysSent) {
+  Sink sink;
+  limb::ProgressReporter reporter(sink.callback(), std::chrono::hours(1), 0.5f);
+
+  reporter.report(0.0f);
+  ASSERT_EQ((std::vector<float>{0.0f}), sink.reported);
+
+  // Reported after processing started, the first one passes as well
+  Sink late;
+  limb::ProgressReporter lateReporter(late.callback(), std::chrono::hours(1), 0.5f);
+  lateReporter.report(0.3f);
+  lateReporter.report(0.4f);
+  ASSERT_EQ((std::vector<float>{0.3f}), late.reported);
+}
+
+TEST(ProgressReporter, lastSentOnce) {
+  Sink sink;
+  limb::ProgressReporter reporter(sink.callback(), std::chrono::hours(1), 0.5f);
+
+  reporter.report(0.0f);
+  reporter.report(0.9f);
+  // Passes both gates, clamped
+  reporter.report(1.5f);
+  reporter.report(1.0f);
+  reporter.finish();
+  ASSERT_EQ((std::vector<float>{0.0f, 1.0f}), sink.reported);
+
+  // Processing reported no 100% itself
+  Sink finished;
+  limb::ProgressReporter finishedReporter(finished.callback(), std::chrono::hours(1), 0.5f);
+  finishedReporter.report(0.0f);
+  finishedReporter.report(0.9f);
+  finishedReporter.finish();
+  finishedReporter.finish();
+  ASSERT_EQ((std::vector<float>{0.0f, 1.0f}), finished.reported);
+}
+
+TEST(ProgressReporter, callback) {
+  Sink sink;
+  limb::ProgressReporter reporter(sink.callback(), std::chrono::seconds(0), 0.1f);
+
+  limb::ProgressCallback callback = reporter.callback();
+  callback(0.0f);
+  callback(0.01f);
+  callback(1.0f);
+  ASSERT_EQ((std::vector<float>{0.0f, 1.0f}), sink.reported);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
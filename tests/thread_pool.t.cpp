@@ -1,11 +1,29 @@
 #include <gtest/gtest.h>
 
+#include <thread-pool/cancellation-token.hpp>
+#include <thread-pool/resource-scheduler.hpp>
+#include <thread-pool/task-group.hpp>
 #include <thread-pool/thread-pool.hpp>
+#include <thread-pool/timer-wheel.hpp>
+#include <thread-pool/work-stealing-queue.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <future>
+#include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 namespace TestLinkage {
 size_t getWorkerIdForCurrentThread() { return *limb::tp::detail::thread_id(); }
@@ -30,6 +48,1154 @@ TEST(ThreadPool, postJob) {
   ASSERT_EQ(42, r.get());
 }
 
+TEST(ThreadPool, postFromWorker) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  options.setQueueSize(64);
+  constexpr int kSubtasks = 32;
+  std::atomic<int> done{0};
+  std::promise<void> finished;
+
+  limb::tp::ThreadPool pool(options);
+
+  pool.post([&]() {
+    for (int i = 0; i < kSubtasks; ++i) {
+      pool.post([&]() {
+        if (done.fetch_add(1) + 1 == kSubtasks) {
+          finished.set_value();
+        }
+      });
+    }
+  });
+
+  ASSERT_EQ(std::future_status::ready, finished.get_future().wait_for(std::chrono::seconds(5)));
+  ASSERT_EQ(kSubtasks, done.load());
+}
+
+TEST(ThreadPool, postFromManyThreads) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  options.setQueueSize(1024);
+  constexpr int kProducers = 4;
+  constexpr int kTasks = 500;
+  std::atomic<int> done{0};
+
+  limb::tp::ThreadPool pool(options);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&]() {
+      for (int i = 0; i < kTasks; ++i) {
+        while (!pool.tryPost([&]() { done.fetch_add(1); })) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &t : producers) {
+    t.join();
+  }
+
+  for (int i = 0; i < 500 && done.load() != kProducers * kTasks; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(kProducers * kTasks, done.load());
+}
+
+TEST(ThreadPool, wakeParkedWorkers) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  limb::tp::ThreadPool pool(options);
+
+  for (int round = 0; round < 3; ++round) {
+    // let all workers exhaust spinning and park
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::packaged_task<int()> t([round]() { return round; });
+    std::future<int> r = t.get_future();
+    pool.post(t);
+
+    ASSERT_EQ(std::future_status::ready, r.wait_for(std::chrono::seconds(5)));
+    ASSERT_EQ(round, r.get());
+  }
+}
+
+TEST(ThreadPool, postForWaitsForSpace) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setQueueSize(2);
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> done{0};
+
+  limb::tp::ThreadPool pool(options);
+  ASSERT_EQ(2u, pool.capacity());
+
+  // occupy the only worker, then fill its queue
+  std::promise<void> started;
+  pool.post([&]() {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+  pool.post([&]() { done.fetch_add(1); });
+  pool.post([&]() { done.fetch_add(1); });
+
+  ASSERT_EQ(2u, pool.size());
+  ASSERT_FALSE(pool.tryPost([&]() { done.fetch_add(1); }));
+  ASSERT_FALSE(pool.postFor([&]() { done.fetch_add(1); }, std::chrono::milliseconds(5)));
+
+  std::thread releaser([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.set_value();
+  });
+  ASSERT_TRUE(pool.postFor([&]() { done.fetch_add(1); }, std::chrono::seconds(5)));
+  releaser.join();
+
+  for (int i = 0; i < 500 && done.load() != 3; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(3, done.load());
+}
+
+TEST(ThreadPool, watermarks) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setQueueSize(8);
+  options.setWatermarks(1, 4);
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::mutex eventsMutex;
+  std::vector<bool> events;
+
+  limb::tp::ThreadPool pool(options);
+  pool.setWatermarkHandler([&](bool saturated) {
+    std::lock_guard lock(eventsMutex);
+    events.push_back(saturated);
+  });
+
+  std::promise<void> started;
+  pool.post([&]() {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+
+  for (int i = 0; i < 5; ++i) {
+    pool.post([]() {});
+  }
+  {
+    std::lock_guard lock(eventsMutex);
+    ASSERT_EQ(std::vector<bool>{true}, events);
+  }
+
+  release.set_value();
+  for (int i = 0; i < 500 && pool.size() != 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  std::lock_guard lock(eventsMutex);
+  ASSERT_EQ((std::vector<bool>{true, false}), events);
+}
+
+TEST(ThreadPool, priorityLanes) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setLaneCount(2);
+  options.setAgingInterval(4);
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::mutex orderMutex;
+  std::vector<size_t> order;
+  std::atomic<int> done{0};
+
+  limb::tp::ThreadPool pool(options);
+  ASSERT_EQ(2u, pool.laneCount());
+
+  std::promise<void> started;
+  pool.post([&]() {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+
+  constexpr int kTasks = 8;
+  for (size_t lane : {1u, 0u}) {
+    for (int i = 0; i < kTasks; ++i) {
+      pool.post(
+          [&, lane]() {
+            std::lock_guard lock(orderMutex);
+            order.push_back(lane);
+            done.fetch_add(1);
+          },
+          lane);
+    }
+  }
+  release.set_value();
+
+  for (int i = 0; i < 500 && done.load() != 2 * kTasks; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(2 * kTasks, done.load());
+
+  std::lock_guard lock(orderMutex);
+  // high priority lane goes first
+  ASSERT_EQ(0u, order[0]);
+  ASSERT_EQ(0u, order[1]);
+  // but low priority lane is served before high priority one is drained
+  const auto lastHigh = std::find(order.rbegin(), order.rend(), 0u);
+  const auto firstLow = std::find(order.begin(), order.end(), 1u);
+  ASSERT_LT(firstLow - order.begin(), order.rend() - lastHigh - 1);
+}
+
+TEST(ThreadPool, submit) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  options.setFutureSlabSize(4);
+  limb::tp::ThreadPool pool(options);
+
+  // more pending results than slab blocks: the rest falls back to the heap
+  std::vector<limb::tp::Future<std::string>> results;
+  for (int i = 0; i < 16; ++i) {
+    results.push_back(pool.submit([i]() { return std::to_string(i); }));
+  }
+  for (int i = 0; i < 16; ++i) {
+    ASSERT_EQ(std::to_string(i), results[i].get());
+    ASSERT_FALSE(results[i].valid());
+  }
+
+  auto failed = pool.submit([]() -> int { throw std::logic_error("failed"); });
+  ASSERT_THROW(failed.get(), std::logic_error);
+
+  std::atomic<bool> ran{false};
+  auto done = pool.submit([&ran]() { ran.store(true); });
+  done.wait();
+  ASSERT_TRUE(done.isReady());
+  done.get();
+  ASSERT_TRUE(ran.load());
+}
+
+TEST(ThreadPool, stats) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  options.setQueueSize(2);
+  limb::tp::ThreadPool pool(options);
+
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+
+  size_t posted = 0;
+  while (pool.tryPost([gate]() { gate.wait(); })) {
+    ++posted;
+  }
+  ASSERT_FALSE(pool.tryPost([]() {}));
+
+  auto busy = pool.stats().total();
+  ASSERT_EQ(posted, busy.posted);
+  ASSERT_EQ(2u, busy.rejected);
+  ASSERT_LE(busy.occupancy, posted);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  release.set_value();
+
+  for (int i = 0; i < 500 && pool.stats().total().executed != posted; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  const auto stats = pool.stats();
+  ASSERT_EQ(2u, stats.workers.size());
+
+  const auto total = stats.total();
+  ASSERT_EQ(posted, total.executed);
+  ASSERT_EQ(0u, total.occupancy);
+  ASSERT_EQ(posted, total.wait_time.count);
+  ASSERT_EQ(posted, total.run_time.count);
+  // every task waited in the queue or on the gate for at least 5ms
+  ASSERT_GE(total.wait_time.percentile(100) + total.run_time.percentile(100), 5000000u);
+  ASSERT_LE(total.run_time.percentile(0), total.run_time.percentile(100));
+}
+
+TEST(ThreadPool, latencyHistogramBuckets) {
+  using limb::tp::LatencyHistogram;
+
+  for (uint64_t v : {0ull, 7ull, 8ull, 9ull, 1000ull, 123456789ull, 1ull << 42}) {
+    const size_t index = LatencyHistogram::bucketIndex(v);
+    ASSERT_LE(v, LatencyHistogram::bucketUpperBound(index));
+    if (index > 0) {
+      ASSERT_GT(v, LatencyHistogram::bucketUpperBound(index - 1));
+    }
+  }
+  ASSERT_EQ(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::bucketIndex(UINT64_MAX));
+}
+
+TEST(ThreadPool, workerPlacement) {
+  using limb::tp::CpuTopology;
+  using limb::tp::WorkerPlacement;
+
+  ASSERT_EQ((std::vector<size_t>{0, 1, 2, 3, 8, 10, 11}), CpuTopology::parseCpuList("0-3,8,10-11"));
+
+  const CpuTopology topology({{0, 1, 2, 3}, {4, 5, 6, 7}});
+  using Placement = std::vector<std::vector<size_t>>;
+
+  ASSERT_EQ((Placement{{0}, {1}, {2}}), topology.place(3, WorkerPlacement::kCompact, {}));
+  ASSERT_EQ((Placement{{0}, {4}, {1}}), topology.place(3, WorkerPlacement::kSpread, {}));
+  ASSERT_EQ((Placement{{5}, {6}, {5}}), topology.place(3, WorkerPlacement::kSpread, {5, 6}));
+  ASSERT_EQ((Placement{{}, {}}), topology.place(2, WorkerPlacement::kNone, {}));
+  ASSERT_EQ((Placement{{1, 4}, {1, 4}}), topology.place(2, WorkerPlacement::kNone, {4, 1}));
+  ASSERT_EQ((Placement{{}, {}}), topology.place(2, WorkerPlacement::kCompact, {42}));
+
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  options.setPlacement(WorkerPlacement::kCompact);
+  limb::tp::ThreadPool pool(options);
+
+  auto result = pool.submit([]() { return 42; });
+  ASSERT_EQ(42, result.get());
+}
+
+TEST(ThreadPool, elastic) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setThreadBounds(1, 4);
+  options.setGrowThreshold(std::chrono::milliseconds(5));
+  options.setKeepAlive(std::chrono::milliseconds(50));
+
+  std::mutex resizeMutex;
+  std::vector<std::pair<size_t, size_t>> resizes;
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+
+  limb::tp::ThreadPool pool(options);
+  pool.setResizeHandler([&](size_t from, size_t to) {
+    std::lock_guard lock(resizeMutex);
+    resizes.emplace_back(from, to);
+  });
+  ASSERT_EQ(1u, pool.threadCount());
+
+  // every task blocks its worker, so the queue is only drained by new workers
+  std::vector<limb::tp::Future<size_t>> results;
+  for (int i = 0; i < 4; ++i) {
+    results.push_back(pool.submit([gate]() {
+      gate.wait();
+      return TestLinkage::getWorkerIdForCurrentThread();
+    }));
+  }
+
+  for (int i = 0; i < 500 && pool.threadCount() != 4; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(4u, pool.threadCount());
+
+  release.set_value();
+  for (auto &result : results) {
+    ASSERT_LT(result.get(), 4u);
+  }
+
+  for (int i = 0; i < 500 && pool.threadCount() != 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(1u, pool.threadCount());
+
+  const auto stats = pool.stats();
+  ASSERT_EQ(3u, stats.grown);
+  ASSERT_EQ(3u, stats.shrunk);
+
+  // retired slots are reused
+  ASSERT_EQ(7, pool.submit([]() { return 7; }).get());
+
+  std::lock_guard lock(resizeMutex);
+  ASSERT_EQ(6u, resizes.size());
+  ASSERT_EQ((std::pair<size_t, size_t>{1, 2}), resizes.front());
+  ASSERT_EQ((std::pair<size_t, size_t>{2, 1}), resizes.back());
+}
+
+TEST(ThreadPool, blocking) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  options.setMaxCompensationThreads(2);
+  options.setKeepAlive(std::chrono::milliseconds(50));
+  limb::tp::ThreadPool pool(options);
+
+  // foreign thread just makes the call
+  ASSERT_EQ(3, pool.blocking([]() { return 3; }));
+
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+  std::atomic<size_t> blocked{0};
+  std::vector<limb::tp::Future<size_t>> io;
+  for (int i = 0; i < 2; ++i) {
+    io.push_back(pool.submit([&pool, &blocked, gate]() {
+      return pool.blocking([&blocked, gate]() {
+        blocked.fetch_add(1);
+        gate.wait();
+        return TestLinkage::getWorkerIdForCurrentThread();
+      });
+    }));
+  }
+  while (blocked.load() != 2) {
+    std::this_thread::yield();
+  }
+
+  // the blocked tasks may run on a compensating worker, then the other initial one is parked and takes over
+  auto cpu = pool.submit([]() { return 7; });
+  for (int i = 0; i < 500 && !cpu.isReady(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(cpu.isReady());
+  ASSERT_EQ(7, cpu.get());
+  ASSERT_GE(pool.threadCount(), 3u);
+  ASSERT_LE(pool.threadCount(), 4u);
+  ASSERT_EQ(pool.threadCount() - 2, pool.stats().compensated);
+
+  release.set_value();
+  for (auto &result : io) {
+    ASSERT_LT(result.get(), 4u);
+  }
+
+  // compensating workers are retired once idle
+  for (int i = 0; i < 500 && pool.threadCount() != 2; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(2u, pool.threadCount());
+}
+
+TEST(TimerWheel, expiresInOrder) {
+  using Wheel = limb::tp::TimerWheel<std::function<void()>>;
+  Wheel wheel(5);
+
+  std::vector<uint64_t> fired;
+  // level 0, level 1, level 3 and overflow deadlines
+  for (uint64_t tick : {7u, 100u, 70000u, 1u << 25}) {
+    wheel.add(Wheel::create(tick, 0, [&fired, tick]() { fired.push_back(tick); }));
+  }
+  Wheel::Entry *cancelled = Wheel::create(300, 0, [&fired]() { fired.push_back(0); });
+  limb::tp::TimerHandle handle(cancelled);
+  wheel.add(cancelled);
+  ASSERT_EQ(7u, wheel.nextTick());
+  ASSERT_TRUE(handle.cancel());
+
+  auto run = [](Wheel::Entry *expired) {
+    while (expired) {
+      Wheel::Entry *entry = std::exchange(expired, expired->next);
+      if (entry->state != limb::tp::detail::TimerEntryBase::kCancelled) {
+        entry->task();
+      }
+      entry->unref();
+    }
+  };
+
+  Wheel::Entry *expired = nullptr;
+  wheel.advance(99, expired);
+  run(expired);
+  ASSERT_EQ(std::vector<uint64_t>{7}, fired);
+
+  for (uint64_t now : {100u, 69999u, 70000u, (1u << 25) - 1, 1u << 25}) {
+    expired = nullptr;
+    wheel.advance(now, expired);
+    run(expired);
+  }
+  ASSERT_EQ((std::vector<uint64_t>{7, 100, 70000, 1u << 25}), fired);
+  ASSERT_TRUE(wheel.empty());
+  ASSERT_EQ(Wheel::NEVER, wheel.nextTick());
+}
+
+TEST(ThreadPool, postAfter) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  limb::tp::ThreadPool pool(options);
+
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  std::promise<clock::time_point> late;
+  std::promise<clock::time_point> early;
+  std::atomic<bool> cancelledRan{false};
+  pool.postAfter(std::chrono::milliseconds(60), [&late]() { late.set_value(clock::now()); });
+  pool.postAt(start + std::chrono::milliseconds(20), [&early]() { early.set_value(clock::now()); });
+  limb::tp::TimerHandle handle =
+      pool.postAfter(std::chrono::milliseconds(40), [&cancelledRan]() { cancelledRan = true; });
+  ASSERT_TRUE(handle.isPending());
+  ASSERT_TRUE(handle.cancel());
+  ASSERT_FALSE(handle.cancel());
+
+  const auto earlyAt = early.get_future().get();
+  const auto lateAt = late.get_future().get();
+  ASSERT_GE(earlyAt - start, std::chrono::milliseconds(20));
+  ASSERT_GE(lateAt - start, std::chrono::milliseconds(60));
+  ASSERT_LT(earlyAt, lateAt);
+  ASSERT_FALSE(cancelledRan);
+
+  // passed deadline posts at once, fired timer is not cancelled
+  std::promise<void> passed;
+  limb::tp::TimerHandle fired = pool.postAt(start, [&passed]() { passed.set_value(); });
+  passed.get_future().wait();
+  ASSERT_FALSE(fired.isPending());
+  ASSERT_FALSE(fired.cancel());
+
+  // pending timers are dropped with the pool
+  limb::tp::TimerHandle dropped = pool.postAfter(std::chrono::hours(1), []() {});
+  pool = limb::tp::ThreadPool(options);
+  ASSERT_FALSE(dropped.isPending());
+}
+
+TEST(MPMCBoundedQueue, bulk) {
+  limb::tp::MPMCBoundedQueue<int> queue(8);
+
+  std::vector<int> in{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  ASSERT_EQ(8u, queue.pushN(in.begin(), in.size()));
+  ASSERT_EQ(0u, queue.pushN(in.begin() + 8, 2));
+
+  std::vector<int> out;
+  ASSERT_EQ(3u, queue.popN(std::back_inserter(out), 3));
+  ASSERT_EQ((std::vector<int>{1, 2, 3}), out);
+
+  ASSERT_EQ(2u, queue.pushN(in.begin() + 8, 2));
+  ASSERT_EQ(7u, queue.popN(std::back_inserter(out), 100));
+  ASSERT_EQ(in, out);
+  ASSERT_EQ(0u, queue.popN(std::back_inserter(out), 100));
+}
+
+TEST(MPMCBoundedQueue, bulkConcurrent) {
+  limb::tp::MPMCBoundedQueue<int> queue(64);
+  constexpr int kPerProducer = 5000;
+
+  std::atomic<long long> sum{0};
+  std::atomic<int> popped{0};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < 2; ++p) {
+    threads.emplace_back([&queue, p]() {
+      std::vector<int> batch(7);
+      for (int i = 0; i < kPerProducer;) {
+        const size_t n = std::min<size_t>(batch.size(), kPerProducer - i);
+        for (size_t j = 0; j < n; ++j) {
+          batch[j] = p * kPerProducer + i + int(j) + 1;
+        }
+        size_t pushed = 0;
+        while (pushed < n) {
+          const size_t accepted = queue.pushN(batch.begin() + pushed, n - pushed);
+          if (accepted == 0) {
+            std::this_thread::yield();
+          }
+          pushed += accepted;
+        }
+        i += int(n);
+      }
+    });
+  }
+  for (int c = 0; c < 2; ++c) {
+    threads.emplace_back([&]() {
+      std::vector<int> batch;
+      while (popped.load() < 2 * kPerProducer) {
+        batch.clear();
+        const size_t n = queue.popN(std::back_inserter(batch), 5);
+        if (n == 0) {
+          std::this_thread::yield();
+        }
+        for (int v : batch) {
+          sum += v;
+        }
+        popped += int(n);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const long long n = 2 * kPerProducer;
+  ASSERT_EQ(n * (n + 1) / 2, sum.load());
+}
+
+TEST(ThreadPool, postBulk) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  options.setQueueSize(16);
+  limb::tp::ThreadPool pool(options);
+
+  std::atomic<int> done{0};
+  auto job = [&done]() { done.fetch_add(1); };
+  std::vector<decltype(job)> jobs(40, job);
+
+  size_t posted = 0;
+  while (posted < jobs.size()) {
+    posted += pool.postBulk(std::ranges::subrange(jobs.begin() + posted, jobs.end()));
+  }
+
+  // fan out from a worker goes to its local deque first
+  std::promise<size_t> nested;
+  pool.post([&]() {
+    std::vector<decltype(job)> more(8, job);
+    nested.set_value(pool.postBulk(more));
+  });
+  ASSERT_EQ(8u, nested.get_future().get());
+
+  for (int i = 0; i < 500 && done.load() != 48; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(48, done.load());
+}
+
+TEST(ThreadPool, postBulkRejected) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setQueueSize(4);
+  limb::tp::ThreadPool pool(options);
+
+  std::promise<void> release;
+  std::shared_future<void> gate = release.get_future().share();
+  std::promise<void> started;
+  pool.post([&]() {
+    started.set_value();
+    gate.wait();
+  });
+  started.get_future().wait();
+
+  std::atomic<int> done{0};
+  auto job = [&done]() { done.fetch_add(1); };
+  std::vector<decltype(job)> jobs(pool.capacity() + 3, job);
+
+  // Every handler which didn't fit is counted
+  const size_t posted = pool.postBulk(jobs);
+  ASSERT_LT(posted, jobs.size());
+  ASSERT_EQ(jobs.size() - posted, pool.stats().total().rejected);
+
+  release.set_value();
+  for (int i = 0; i < 500 && done.load() != int(posted); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(int(posted), done.load());
+}
+
+TEST(MPMCUnboundedQueue, growsAndRecycles) {
+  ASSERT_THROW(limb::tp::MPMCUnboundedQueue<int> bad(3), std::invalid_argument);
+
+  limb::tp::MPMCUnboundedQueue<int> queue(4);
+  ASSERT_EQ(SIZE_MAX, queue.capacity());
+
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      ASSERT_TRUE(queue.push(i));
+    }
+    std::vector<int> in(50);
+    std::iota(in.begin(), in.end(), 50);
+    ASSERT_EQ(in.size(), queue.pushN(in.begin(), in.size()));
+    ASSERT_EQ(100u, queue.size());
+
+    std::vector<int> out;
+    int value = -1;
+    while (queue.popN(std::back_inserter(out), 3) != 0) {
+    }
+    ASSERT_FALSE(queue.pop(value));
+    ASSERT_EQ(100u, out.size());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(i, out[i]);
+    }
+  }
+}
+
+TEST(MPMCUnboundedQueue, concurrent) {
+  // Short segments to make producers link and consumers recycle them often
+  limb::tp::MPMCUnboundedQueue<int> queue(8);
+  constexpr int kPerProducer = 20000;
+
+  std::atomic<long long> sum{0};
+  std::atomic<int> popped{0};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < 2; ++p) {
+    threads.emplace_back([&queue, p]() {
+      std::vector<int> batch(5);
+      for (int i = 0; i < kPerProducer;) {
+        if (i % 2 == 0) {
+          queue.push(p * kPerProducer + i + 1);
+          ++i;
+          continue;
+        }
+        const size_t n = std::min<size_t>(batch.size(), kPerProducer - i);
+        for (size_t j = 0; j < n; ++j) {
+          batch[j] = p * kPerProducer + i + int(j) + 1;
+        }
+        queue.pushN(batch.begin(), n);
+        i += int(n);
+      }
+    });
+  }
+  for (int c = 0; c < 2; ++c) {
+    threads.emplace_back([&]() {
+      std::vector<int> batch;
+      while (popped.load() < 2 * kPerProducer) {
+        batch.clear();
+        const size_t n = queue.popN(std::back_inserter(batch), 3);
+        if (n == 0) {
+          std::this_thread::yield();
+        }
+        for (int v : batch) {
+          sum += v;
+        }
+        popped += int(n);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const long long n = 2 * kPerProducer;
+  ASSERT_EQ(n * (n + 1) / 2, sum.load());
+  ASSERT_EQ(0u, queue.size());
+}
+
+TEST(WorkStealingQueue, pushPopPush) {
+  limb::tp::WorkStealingQueue<int> queue(4);
+  int value = -1;
+
+  ASSERT_TRUE(queue.push(1));
+  ASSERT_TRUE(queue.push(2));
+  ASSERT_TRUE(queue.pop(value));
+  ASSERT_EQ(2, value);
+  ASSERT_TRUE(queue.pop(value));
+  ASSERT_EQ(1, value);
+  ASSERT_FALSE(queue.pop(value));
+  ASSERT_EQ(0u, queue.size());
+
+  // Cells emptied by the owner take new work right away
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(queue.push(i));
+    }
+    ASSERT_FALSE(queue.push(4));
+    ASSERT_EQ(4u, queue.size());
+    for (int i = 3; i >= 0; --i) {
+      ASSERT_TRUE(queue.pop(value));
+      ASSERT_EQ(i, value);
+    }
+  }
+}
+
+TEST(WorkStealingQueue, wrapAround) {
+  limb::tp::WorkStealingQueue<int> queue(4);
+  int value = -1;
+
+  // Top and bottom move over many laps of the buffer, taken from both ends
+  int next = 0;
+  int expectedTop = 0;
+  for (int round = 0; round < 100; ++round) {
+    ASSERT_TRUE(queue.push(next++));
+    ASSERT_TRUE(queue.push(next++));
+    ASSERT_TRUE(queue.push(next++));
+    ASSERT_TRUE(queue.steal(value));
+    ASSERT_EQ(expectedTop, value);
+    ASSERT_TRUE(queue.pop(value));
+    ASSERT_EQ(next - 1, value);
+    // The last element goes to the owner through the race with thieves
+    ASSERT_TRUE(queue.pop(value));
+    ASSERT_EQ(next - 2, value);
+    ASSERT_FALSE(queue.pop(value));
+    ASSERT_FALSE(queue.steal(value));
+    expectedTop = next;
+  }
+  ASSERT_EQ(0u, queue.size());
+}
+
+TEST(WorkStealingQueue, popVersusSteal) {
+  limb::tp::WorkStealingQueue<int> queue(64);
+  constexpr int kItems = 20000;
+
+  std::vector<std::atomic<int>> seen(kItems);
+  std::atomic<int> taken{0};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back([&]() {
+      int value = -1;
+      while (!done.load()) {
+        if (queue.steal(value)) {
+          seen[value]++;
+          taken++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  int value = -1;
+  for (int i = 0; i < kItems;) {
+    if (queue.push(i)) {
+      ++i;
+    } else {
+      std::this_thread::yield();
+    }
+    // Keep the queue short, so the owner often races thieves for the last element
+    if (i % 3 == 0 && queue.pop(value)) {
+      seen[value]++;
+      taken++;
+    }
+  }
+  while (queue.pop(value)) {
+    seen[value]++;
+    taken++;
+  }
+  while (taken.load() < kItems) {
+    std::this_thread::yield();
+  }
+  done = true;
+  for (auto &thread : thieves) {
+    thread.join();
+  }
+
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_EQ(1, seen[i].load()) << i;
+  }
+  ASSERT_EQ(0u, queue.size());
+}
+
+TEST(ThreadPool, unboundedQueue) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  options.setQueueSize(2);
+  limb::tp::UnboundedThreadPool pool(options);
+  ASSERT_EQ(SIZE_MAX, pool.capacity());
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  pool.post([released]() { released.wait(); });
+
+  // Worker is blocked, tasks are buffered instead of being rejected
+  std::atomic<int> done{0};
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(pool.tryPost([&done]() { done.fetch_add(1); }));
+  }
+  release.set_value();
+
+  for (int i = 0; i < 500 && done.load() != 100; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(100, done.load());
+}
+
+namespace {
+template <template <typename> class Queue> double queueThroughput(size_t threads, size_t ops) {
+  Queue<int> queue(1024);
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      while (!go.load()) {
+      }
+      int value = 0;
+      for (size_t i = 0; i < ops; ++i) {
+        while (!queue.push(int(i))) {
+          std::this_thread::yield();
+        }
+        while (!queue.pop(value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  go.store(true);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return double(threads * ops * 2) / elapsed.count();
+}
+} // namespace
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter='*Benchmark*'
+TEST(QueueBenchmark, DISABLED_boundedVsUnbounded) {
+  for (size_t threads : {1u, 2u, 4u, 8u}) {
+    const double bounded = queueThroughput<limb::tp::MPMCBoundedQueue>(threads, 1000000);
+    const double unbounded = queueThroughput<limb::tp::MPMCUnboundedQueue>(threads, 1000000);
+    std::cout << "threads: " << threads << " bounded: " << size_t(bounded) << " ops/s unbounded: " << size_t(unbounded)
+              << " ops/s\n";
+  }
+}
+
+namespace {
+limb::tp::CoTask<int> answer(limb::tp::ThreadPool &pool) {
+  co_await pool.schedule();
+  co_return 42;
+}
+
+limb::tp::CoTask<int> failing() {
+  throw std::runtime_error("failed");
+  co_return 0;
+}
+
+limb::tp::CoTask<void> pipeline(limb::tp::ThreadPool &pool, std::promise<std::vector<int>> &done) {
+  std::vector<int> result;
+  co_await pool.schedule();
+  result.push_back(limb::tp::Worker<limb::tp::FixedFunction<void(), 128>, limb::tp::MPMCBoundedQueue>::
+                           getWorkerIdForCurrentThread() != size_t(-1));
+  result.push_back(co_await answer(pool));
+  try {
+    co_await failing();
+  } catch (const std::runtime_error &) {
+    result.push_back(-1);
+  }
+  result.push_back(co_await limb::tp::offload(pool, []() { return 7; }));
+  done.set_value(std::move(result));
+}
+} // namespace
+
+TEST(ThreadPool, coroutines) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  limb::tp::ThreadPool pool(options);
+
+  std::promise<std::vector<int>> started;
+  pool.spawn(pipeline(pool, started));
+  ASSERT_EQ((std::vector<int>{1, 42, -1, 7}), started.get_future().get());
+
+  // Detached task starts on the current thread and hops to the pool
+  std::promise<std::vector<int>> detached;
+  pipeline(pool, detached).detach();
+  ASSERT_EQ((std::vector<int>{1, 42, -1, 7}), detached.get_future().get());
+}
+
+TEST(ThreadPool, scheduleAfter) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  limb::tp::ThreadPool pool(options);
+
+  const auto delay = std::chrono::milliseconds(20);
+  std::promise<std::pair<std::thread::id, std::chrono::steady_clock::duration>> resumed;
+  auto sleeper = [&]() -> limb::tp::CoTask<void> {
+    const auto start = std::chrono::steady_clock::now();
+    co_await pool.scheduleAfter(delay);
+    resumed.set_value({std::this_thread::get_id(), std::chrono::steady_clock::now() - start});
+  };
+
+  // Started on the test thread, resumed by the worker after the delay
+  sleeper().detach();
+  const auto [thread, elapsed] = resumed.get_future().get();
+  ASSERT_NE(std::this_thread::get_id(), thread);
+  ASSERT_GE(elapsed, delay);
+}
+
+TEST(FramePool, recyclesFrames) {
+  void *frame = limb::tp::FramePool::allocate(200);
+  limb::tp::FramePool::deallocate(frame, 200);
+  ASSERT_EQ(frame, limb::tp::FramePool::allocate(256));
+  limb::tp::FramePool::deallocate(frame, 256);
+
+  void *big = limb::tp::FramePool::allocate(limb::tp::FramePool::MAX_BLOCK_SIZE + 1);
+  limb::tp::FramePool::deallocate(big, limb::tp::FramePool::MAX_BLOCK_SIZE + 1);
+}
+
+TEST(CancellationToken, cancelAndDeadline) {
+  limb::tp::CancellationToken never;
+  ASSERT_FALSE(never.canBeCancelled());
+  ASSERT_FALSE(never.isCancelled());
+
+  limb::tp::CancellationSource expiring;
+  expiring.cancelAfter(std::chrono::milliseconds(20));
+  const limb::tp::CancellationToken token = expiring.token();
+  ASSERT_TRUE(token.canBeCancelled());
+  ASSERT_FALSE(token.isCancelled());
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ASSERT_TRUE(token.isCancelled());
+
+  limb::tp::CancellationSource expired;
+  expired.cancelAfter(std::chrono::milliseconds(-5));
+  ASSERT_TRUE(expired.isCancelled());
+}
+
+TEST(CancellationToken, stopsRunningTask) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(2);
+  limb::tp::ThreadPool pool(options);
+
+  limb::tp::CancellationSource source;
+  std::promise<void> started;
+  std::promise<size_t> stopped;
+  pool.post([token = source.token(), &started, &stopped]() {
+    size_t tiles = 0;
+    for (; !token.isCancelled(); ++tiles) {
+      if (tiles == 0) {
+        started.set_value();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stopped.set_value(tiles);
+  });
+
+  started.get_future().wait();
+  source.cancel();
+  auto result = stopped.get_future();
+  ASSERT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(5)));
+  ASSERT_GT(result.get(), 0);
+}
+
+TEST(TaskGroup, nestedForkJoin) {
+  // A single worker waiting for nested groups has to run their tasks itself
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  limb::tp::ThreadPool pool(options);
+
+  std::array<std::atomic<size_t>, 8> sums{};
+  auto result = pool.submit([&pool, &sums]() {
+    limb::tp::TaskGroup outer(pool);
+    for (size_t i = 0; i < sums.size(); ++i) {
+      outer.run([&pool, &sums, i]() {
+        limb::tp::TaskGroup inner(pool);
+        for (size_t j = 1; j <= 10; ++j) {
+          inner.run([&sums, i, j]() { sums[i] += j; });
+        }
+        inner.wait();
+      });
+    }
+    outer.wait();
+    return std::accumulate(sums.begin(), sums.end(), size_t(0));
+  });
+  ASSERT_EQ(sums.size() * 55, result.get());
+
+  // foreign thread helps as well
+  limb::tp::TaskGroup group(pool);
+  std::atomic<size_t> count{0};
+  for (int i = 0; i < 100; ++i) {
+    group.run([&count]() { ++count; });
+  }
+  group.wait();
+  ASSERT_EQ(100u, count.load());
+}
+
+TEST(TaskGroup, failureCancelsGroup) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(1);
+  limb::tp::ThreadPool pool(options);
+
+  // keep the worker busy, so the foreign thread runs the tasks in order
+  std::promise<void> release;
+  pool.post([gate = release.get_future().share()]() { gate.wait(); });
+
+  limb::tp::TaskGroup group(pool);
+  std::atomic<size_t> ran{0};
+  group.run([&ran]() { ++ran; });
+  group.run([]() { throw std::runtime_error("stripe failed"); });
+  group.run([&ran]() { ++ran; });
+  ASSERT_THROW(group.wait(), std::runtime_error);
+  ASSERT_EQ(1u, ran.load());
+  ASSERT_TRUE(group.token().isCancelled());
+
+  enum class Status { kOk, kFailed };
+  limb::tp::TaskGroup<limb::tp::ThreadPool, Status> statuses(pool);
+  statuses.run([]() { return Status::kOk; });
+  statuses.run([]() { return Status::kFailed; });
+  statuses.run([&ran]() {
+    ++ran;
+    return Status::kOk;
+  });
+  ASSERT_EQ(Status::kFailed, statuses.wait());
+  ASSERT_EQ(1u, ran.load());
+  release.set_value();
+}
+
+TEST(ResourceScheduler, tryAcquire) {
+  limb::tp::ResourceScheduler scheduler(2, {{.inferenceSlots = 1, .memoryBudget = 100},
+                                            {.inferenceSlots = 2, .memoryBudget = 0}});
+  ASSERT_EQ(3, scheduler.inferenceSlots());
+
+  // CPU stages don't touch devices
+  limb::tp::ResourceGrant cpu1, cpu2, cpu3;
+  ASSERT_TRUE(scheduler.tryAcquire({.cpu = 1}, cpu1));
+  ASSERT_EQ(limb::tp::ResourceRequest::ANY_DEVICE, cpu1.device());
+  ASSERT_TRUE(scheduler.tryAcquire({.cpu = 1}, cpu2));
+  ASSERT_FALSE(scheduler.tryAcquire({.cpu = 1}, cpu3));
+
+  // Inference goes to the least loaded device while CPU slots are busy
+  limb::tp::ResourceGrant infer1, infer2, infer3, infer4;
+  ASSERT_TRUE(scheduler.tryAcquire({.inference = 1}, infer1));
+  ASSERT_EQ(1, infer1.device());
+  ASSERT_TRUE(scheduler.tryAcquire({.inference = 1, .memory = 500}, infer2));
+  ASSERT_EQ(0, infer2.device()) << "memory above the budget is clamped to it";
+  ASSERT_TRUE(scheduler.tryAcquire({.inference = 1}, infer3));
+  ASSERT_FALSE(scheduler.tryAcquire({.inference = 1}, infer4));
+
+  infer2.release();
+  ASSERT_FALSE(scheduler.tryAcquire({.inference = 1, .device = 1}, infer4));
+  ASSERT_TRUE(scheduler.tryAcquire({.inference = 1, .device = 0}, infer4));
+
+  cpu1 = std::move(cpu2);
+  ASSERT_TRUE(scheduler.tryAcquire({.cpu = 1}, cpu3));
+
+  ASSERT_THROW(scheduler.tryAcquire({.cpu = 3}, cpu3), std::invalid_argument);
+  ASSERT_THROW(scheduler.tryAcquire({.inference = 3}, cpu3), std::invalid_argument);
+  ASSERT_THROW(scheduler.tryAcquire({.inference = 1, .device = 2}, cpu3), std::invalid_argument);
+  ASSERT_THROW(limb::tp::ResourceScheduler(0, {}), std::invalid_argument);
+}
+
+namespace {
+limb::tp::CoTask<void> infer(limb::tp::ThreadPool &pool, limb::tp::ResourceScheduler &scheduler,
+                             std::atomic<size_t> &running, std::atomic<size_t> &peak, std::atomic<size_t> &done) {
+  co_await pool.schedule();
+  limb::tp::ResourceGrant grant = co_await scheduler.acquire(pool, {.inference = 1});
+  const size_t now = running.fetch_add(1) + 1;
+  size_t prev = peak.load();
+  while (prev < now && !peak.compare_exchange_weak(prev, now)) {
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  running.fetch_sub(1);
+  grant.release();
+  done.fetch_add(1);
+}
+} // namespace
+
+TEST(ResourceScheduler, boundsInference) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  limb::tp::ThreadPool pool(options);
+  limb::tp::ResourceScheduler scheduler(4, {{.inferenceSlots = 2, .memoryBudget = 0}});
+
+  std::atomic<size_t> running{0};
+  std::atomic<size_t> peak{0};
+  std::atomic<size_t> done{0};
+  constexpr size_t count = 64;
+  for (size_t i = 0; i < count; ++i) {
+    pool.spawn(infer(pool, scheduler, running, peak, done));
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (done.load() != count && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(count, done.load());
+  ASSERT_LE(peak.load(), 2);
+
+  // Everything is given back
+  limb::tp::ResourceGrant grant;
+  ASSERT_TRUE(scheduler.tryAcquire({.cpu = 4, .inference = 2}, grant));
+}
+
+TEST(ThreadPool, badQueueSize) {
+  limb::tp::ThreadPoolOptions options;
+  options.setThreadCount(4);
+  options.setQueueSize(3);
+
+  ASSERT_THROW(limb::tp::ThreadPool pool(options), std::invalid_argument);
+}
+
+TEST(FixedFunction, heapFallback) {
+  std::array<int, 64> big;
+  big.fill(7);
+
+  limb::tp::FixedFunction<int(), 32, limb::tp::HeapFallback> f([big]() { return big[63]; });
+  limb::tp::FixedFunction<int(), 32, limb::tp::HeapFallback> g(std::move(f));
+  ASSERT_THROW(f(), std::runtime_error);
+  ASSERT_EQ(7, g());
+
+  limb::tp::FixedFunction<int(), 32, limb::tp::HeapFallback> small([]() { return 1; });
+  small = std::move(g);
+  ASSERT_EQ(7, small());
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();